@@ -5,15 +5,41 @@
 #include <vector>
 #include <random>
 #include <cmath>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <mutex>
+#include <condition_variable>
+#include <tuple>
+#include <thread>
+#include <memory>
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+#include <deque>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "include/pretty.hpp" // https://github.com/jibstack64/pretty
 #include "include/argh.h" // https://github.com/adishavit/argh
+#include "include/trace.hpp"
+#include "include/pool.hpp"
+#include "include/replay.hpp"
+#include "include/spsc.hpp"
+#include "include/search.hpp"
+#include "include/board.hpp"
+#include "include/spectate.hpp"
 
 // drawing characters
 // chars in strings are past U+FFFF therefore require bigger containers
 // has no difference in (game) performance since done at runtime
 #ifndef _WIN32
-#define CONTROLS_GRID std::string("w⬆,a⬅,s⬇,d➡,r⏪")
+#define CONTROLS_GRID std::string("w⬆,a⬅,s⬇,d➡,r⏪,h💡,g x,y,q⏏")
 std::string BOX = pty::paint("▩", "turqoise");
 std::string GBX = pty::paint("✔", "green");
 std::string BGD = pty::paint("□", "grey");
@@ -25,7 +51,7 @@ std::string ERR = pty::paint("?", "lightred");
 #ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
 #define ENABLE_VIRTUAL_TERMINAL_PROCESSING  0x0004
 #endif
-#define CONTROLS_GRID std::string("w,a,s,d,r")
+#define CONTROLS_GRID std::string("w,a,s,d,r,h,g x,y,q")
 std::string BOX = pty::paint("::", "turqoise");
 std::string GBX = pty::paint("**", "green");
 std::string BGD = pty::paint("[]", "grey");
@@ -40,7 +66,7 @@ enum class drawing {
 };
 
 // returns the string matching d.
-const std::string drawToString(drawing d) {
+const std::string& drawToString(drawing d) {
     switch (d) {
         case drawing::FullBox:
         return BOX;
@@ -60,6 +86,56 @@ const std::string drawToString(drawing d) {
     }
 }
 
+// pads every drawing with spaces to the width of the widest, so the grid lines up whatever the overrides are.
+// done once after the overrides are read, so drawing a frame costs nothing extra.
+void alignDrawings() {
+    std::string* all[] = { &BOX, &GBX, &BGD, &PLR, &TRG, &WLL, &ERR };
+    int widest = 0;
+    for (auto d : all) {
+        widest = std::max(widest, pty::width(*d));
+    }
+    for (auto d : all) {
+        d->append(widest - pty::width(*d), ' ');
+    }
+}
+
+// converts a movement key into the direction it moves the player in.
+// returns false if key is not a movement key.
+bool keyToDirection(char key, int& x, int& y) {
+    x = 0;
+    y = 0;
+    switch (key) {
+        case 'w':
+        y = 1; return true;
+        case 'a':
+        x = -1; return true;
+        case 's':
+        y = -1; return true;
+        case 'd':
+        x = 1; return true;
+        default:
+        return false;
+    }
+}
+
+// returns the replay direction of a move by (x, y), or -1 if it is not a single step.
+int directionCode(int x, int y) {
+    for (int d = 0; d < 4; d++) {
+        int dX, dY;
+        keyToDirection(replay::toKey(d), dX, dY);
+        if (dX == x && dY == y) {
+            return d;
+        }
+    }
+    return -1;
+}
+
+// returns a seed for level generation that differs from run to run.
+uint64_t randomSeed() {
+    static std::random_device device;
+    return ((uint64_t)device() << 32) ^ device() ^ std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
 // returns a string containing newline x times, essentially clearing the console.
 const std::string clearConsole(int x = 50) {
     std::string clr = "";
@@ -80,7 +156,7 @@ int fatal(const std::string text, int status = 1) {
 // hosts basic data such as the drawing character and the (x, y) values.
 struct object {
     public:
-    std::string dchar;
+    drawing dchar; // resolved through drawToString when rendering, so no object owns a string
     int x, y;
     // does this object stop the player from moving through?
     bool obstructs = false;
@@ -93,14 +169,14 @@ struct object {
     // should this object render?
     bool render = true;
 
-    // sets dchar to the character matching dc.
+    // sets dchar to dc.
     void setDrawing(drawing dc) {
-        dchar = drawToString(dc);
+        dchar = dc;
     }
 
     // swaps with the contents of obj.
     void swap(object* obj) {
-        std::string dc = dchar;
+        drawing dc = dchar;
         bool obs = obstructs;
         bool cptBox = captureBox;
         bool cptPoint = capturePoint;
@@ -127,12 +203,243 @@ struct object {
     }
 
     explicit object(int sX = 0, int sY = 0, drawing dc = drawing::Error) :
-            x(sX), y(sY), dchar(drawToString(dc)) {}
+            dchar(dc), x(sX), y(sY) {}
+};
+
+// a saved position of a map, holding only the objects that differ from the map's starting layout.
+struct checkpoint {
+    std::vector<std::pair<int, object>> changed; // object index and its state
+    int score = 0;
+    std::vector<uint8_t> journal;
+};
+
+// save files are written field by field, little endian, so they do not depend on how the compiler lays out a struct.
+// appends the low bytes of v to out, least significant first.
+void writeBytes(std::vector<uint8_t>& out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out.push_back((v >> (i*8)) & 0xFF);
+    }
+}
+
+// reads a value written by writeBytes(). signed fields are cast back from the result.
+uint64_t readBytes(const uint8_t* in, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) {
+        v |= (uint64_t)in[i] << (i*8);
+    }
+    return v;
+}
+
+// objects are saved in records of OBJECT_BYTES: drawing (u8), x (i32), y (i32),
+// then obstructs, captureBox, capturePoint, background and render (u8 each, 0 or 1).
+const size_t OBJECT_BYTES = 14;
+
+void writeObject(std::vector<uint8_t>& out, const object& o) {
+    out.push_back((uint8_t)o.dchar);
+    writeBytes(out, (uint32_t)o.x, 4);
+    writeBytes(out, (uint32_t)o.y, 4);
+    for (bool b : { o.obstructs, o.captureBox, o.capturePoint, o.background, o.render }) {
+        out.push_back(b);
+    }
+}
+
+// reads a record written by writeObject() into o. returns false if it holds a value no object can have.
+bool readObject(const uint8_t* in, object& o) {
+    if (in[0] > (uint8_t)drawing::Error) {
+        return false;
+    }
+    for (int i = 9; i < 14; i++) {
+        if (in[i] > 1) {
+            return false;
+        }
+    }
+    o = object((int32_t)readBytes(in + 1, 4), (int32_t)readBytes(in + 5, 4), (drawing)in[0]);
+    o.obstructs = in[9];
+    o.captureBox = in[10];
+    o.capturePoint = in[11];
+    o.background = in[12];
+    o.render = in[13];
+    return true;
+}
+
+// the fixed-size part of a map in a save file. offsets are from the start of the file,
+// and point at arrays of object records, changed object indices (i32) and journal directions (u8).
+struct savedMap {
+    int32_t width, height, player, score, totalScore, originalScore;
+    uint64_t seed, levelHash;
+    uint64_t objectCount, changedCount, journalLength;
+    uint64_t objectsOffset, changedOffset, originalOffset, journalOffset;
 };
 
+// a savedMap is saved as its fields in order, six i32 then nine u64.
+const size_t SAVED_MAP_BYTES = 6*4 + 9*8;
+
+void writeSavedMap(std::vector<uint8_t>& out, const savedMap& s) {
+    for (int32_t v : { s.width, s.height, s.player, s.score, s.totalScore, s.originalScore }) {
+        writeBytes(out, (uint32_t)v, 4);
+    }
+    for (uint64_t v : { s.seed, s.levelHash, s.objectCount, s.changedCount, s.journalLength,
+            s.objectsOffset, s.changedOffset, s.originalOffset, s.journalOffset }) {
+        writeBytes(out, v, 8);
+    }
+}
+
+// reads a record written by writeSavedMap(). its values are checked by map::validSave().
+savedMap readSavedMap(const uint8_t* in) {
+    savedMap s;
+    int32_t* small[] = { &s.width, &s.height, &s.player, &s.score, &s.totalScore, &s.originalScore };
+    uint64_t* large[] = { &s.seed, &s.levelHash, &s.objectCount, &s.changedCount, &s.journalLength,
+            &s.objectsOffset, &s.changedOffset, &s.originalOffset, &s.journalOffset };
+    for (int32_t* v : small) {
+        *v = (int32_t)readBytes(in, 4);
+        in += 4;
+    }
+    for (uint64_t* v : large) {
+        *v = readBytes(in, 8);
+        in += 8;
+    }
+    return s;
+}
+
 struct map {
     private:
-    std::vector<object> _originalObjects;
+    // the indices of objects that may differ from the starting layout, and how each of them started. only these
+    // are kept, so a level that has not been played holds a single copy of its objects and resets only touch what has moved
+    std::vector<int> _changed;
+    std::vector<object> _original;
+    std::vector<char> _isChanged;
+    // the index of the object at every cell, or -1. capture points and background objects are kept
+    // apart from everything else, as the player may stand on top of them.
+    std::vector<int> _movers, _statics;
+    // the cells the player can walk to without pushing anything, only rebuilt after a box has moved
+    std::vector<char> _reach;
+    bool _reachDirty = true;
+    int _reachMin; // the lowest reachable cell, identifies the region whatever the player's position
+    // scratch space for path searches, kept to avoid allocating on every call
+    std::vector<int> _queue, _from;
+    int _originalScore = 0;
+    uint64_t _rngState = 0; // level generation only depends on the seed, so levels can be regenerated from it
+
+    // returns the next pseudo-random number for level generation (splitmix64).
+    uint64_t _random() {
+        uint64_t z = (_rngState += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // hashes text with fnv-1a.
+    static uint64_t _hashText(const std::string& text) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (char ch : text) {
+            h = (h ^ (uint8_t)ch) * 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+    // returns the index of (x, y) in the cell grids. (x, y) must be within the map.
+    int _cell(int x, int y) const {
+        return (y-1)*width + x;
+    }
+
+    // records that obj is about to differ from the starting layout.
+    void _touch(const object* obj) {
+        int i = obj - objects.data();
+        if (!_isChanged[i]) {
+            _isChanged[i] = 1;
+            _changed.push_back(i);
+            _original.push_back(*obj);
+        }
+    }
+
+    // puts every changed object back as it was in the starting layout.
+    void _revert() {
+        for (int i : _changed) {
+            _unplace(&objects[i]);
+        }
+        for (size_t k = 0; k < _changed.size(); k++) {
+            objects[_changed[k]] = _original[k];
+            _isChanged[_changed[k]] = 0;
+        }
+        for (int i : _changed) {
+            _place(&objects[i]);
+        }
+        _changed.clear();
+        _original.clear();
+    }
+
+    // takes the current objects as the starting layout.
+    void _setBase() {
+        _changed.clear();
+        _original.clear();
+        _isChanged.assign(objects.size(), 0);
+        _index();
+    }
+
+    // returns the grid that obj belongs in.
+    std::vector<int>& _layer(const object* obj) {
+        return obj->capturePoint || obj->background ? _statics : _movers;
+    }
+
+    // adds obj to the index at its coordinates, if they are within the map.
+    void _place(object* obj) {
+        if (obj->y >= 1 && obj->y <= height && obj->x >= 0 && obj->x < width) {
+            _layer(obj)[_cell(obj->x, obj->y)] = obj - objects.data();
+        }
+    }
+
+    // takes obj out of the index.
+    void _unplace(object* obj) {
+        if (obj->y >= 1 && obj->y <= height && obj->x >= 0 && obj->x < width) {
+            int& c = _layer(obj)[_cell(obj->x, obj->y)];
+            if (c == obj - objects.data()) {
+                c = -1;
+            }
+        }
+    }
+
+    // can the player walk through cell c without pushing anything?
+    bool _walkable(int c) const {
+        if (_movers[c] != -1 && _movers[c] != player) {
+            return false;
+        }
+        return _statics[c] == -1 || !objects[_statics[c]].obstructs;
+    }
+
+    // flood fills the player's region into _reach.
+    void _flood() {
+        trace::span t("flood");
+        _reach.assign(width*height, 0);
+        _queue.clear();
+        const object& p = objects[player];
+        int start = _cell(p.x, p.y);
+        _reach[start] = 1;
+        _reachMin = start;
+        _queue.push_back(start);
+        for (size_t i = 0; i < _queue.size(); i++) {
+            int c = _queue[i];
+            int cX = c % width;
+            const int next[4] = { cX > 0 ? c-1 : -1, cX < width-1 ? c+1 : -1, c >= width ? c-width : -1, c+width < width*height ? c+width : -1 };
+            for (int n : next) {
+                if (n != -1 && !_reach[n] && _walkable(n)) {
+                    _reach[n] = 1;
+                    _reachMin = std::min(_reachMin, n);
+                    _queue.push_back(n);
+                }
+            }
+        }
+        _reachDirty = false;
+    }
+
+    // rebuilds the index from scratch.
+    void _index() {
+        _movers.assign(width*height, -1);
+        _statics.assign(width*height, -1);
+        // placed in reverse so the earliest object wins a shared cell, as a linear search would
+        for (int i = objects.size()-1; i >= 0; i--) {
+            _place(&objects[i]);
+        }
+    }
 
     public:
     const int width, height;
@@ -140,15 +447,270 @@ struct map {
     int player; // the index that the player object is at in objects
     int score = 0; // score for the level
     int totalScore;
+    uint64_t seed = 0; // the seed the level was generated from, 0 if it was loaded
+    uint64_t levelHash; // hash of the starting layout
+    std::vector<uint8_t> journal; // the player's moves since the last reset, as replay directions
 
-    // resets the map to its starting state.
+    // resets the map to its starting state, only touching the objects that have changed.
     void reset() {
-        objects = _originalObjects;
-        score = 0;
+        _revert();
+        _reachDirty = true;
+        score = _originalScore;
+        journal.clear();
+    }
+
+    // appends the map's arrays to file, and returns the record that points at them.
+    savedMap saveTo(std::vector<uint8_t>& file) const {
+        // every array starts on an 8 byte boundary
+        auto align = [&]() {
+            file.resize((file.size() + 7) & ~(size_t)7);
+            return (uint64_t)file.size();
+        };
+        savedMap s;
+        s.width = width;
+        s.height = height;
+        s.player = player;
+        s.score = score;
+        s.totalScore = totalScore;
+        s.originalScore = _originalScore;
+        s.seed = seed;
+        s.levelHash = levelHash;
+        s.objectCount = objects.size();
+        s.changedCount = _changed.size();
+        s.journalLength = journal.size();
+        s.objectsOffset = align();
+        for (const object& o : objects) {
+            writeObject(file, o);
+        }
+        s.changedOffset = align();
+        for (int c : _changed) {
+            writeBytes(file, (uint32_t)c, 4);
+        }
+        s.originalOffset = align();
+        for (const object& o : _original) {
+            writeObject(file, o);
+        }
+        s.journalOffset = align();
+        file.insert(file.end(), journal.begin(), journal.end());
+        return s;
+    }
+
+    // returns true if s only points inside the save file of size bytes at file, and every object, index and
+    // move it points at is one a map could hold: nothing outside the level but removed targets, one player on the
+    // board, a target for every point of the total score, a captured box for every point scored and each changed
+    // object listed once.
+    static bool validSave(const savedMap& s, const uint8_t* file, size_t size) {
+        auto fits = [&](uint64_t offset, uint64_t count, uint64_t each) {
+            return offset % 8 == 0 && offset <= size && count <= (size - offset) / each;
+        };
+        if (s.width < 1 || s.height < 1 || s.width > 1 << 12 || s.height > 1 << 12
+                || s.player < 0 || (uint64_t)s.player >= s.objectCount || s.changedCount > s.objectCount
+                || s.totalScore < 0 || s.originalScore < 0 || s.originalScore > s.score || s.score > s.totalScore
+                || !fits(s.objectsOffset, s.objectCount, OBJECT_BYTES) || !fits(s.changedOffset, s.changedCount, 4)
+                || !fits(s.originalOffset, s.changedCount, OBJECT_BYTES) || !fits(s.journalOffset, s.journalLength, 1)) {
+            return false;
+        }
+        auto onBoard = [&](const object& o) {
+            return o.x >= 0 && o.x < s.width && o.y >= 1 && o.y <= s.height;
+        };
+        auto removed = [&](const object& o) {
+            return o.x == s.width*4 && o.y == s.height*4;
+        };
+        auto placed = [&](const object& o) {
+            return onBoard(o) || removed(o);
+        };
+        uint64_t targets = 0, boxes = 0, captured = 0, taken = 0;
+        for (uint64_t i = 0; i < s.objectCount; i++) {
+            object o;
+            if (!readObject(file + s.objectsOffset + i*OBJECT_BYTES, o) || (o.capturePoint && o.captureBox)) {
+                return false;
+            }
+            // only targets are ever removed, once a box has been pushed onto them
+            if (o.capturePoint ? !placed(o) : !onBoard(o)) {
+                return false;
+            }
+            if ((int64_t)i == s.player && (o.capturePoint || o.captureBox)) {
+                return false;
+            }
+            targets += o.capturePoint;
+            taken += o.capturePoint && removed(o);
+            boxes += o.captureBox;
+            captured += o.captureBox && o.obstructs;
+        }
+        if (targets != (uint64_t)s.totalScore || 1 + targets + boxes != s.objectCount
+                || captured != (uint64_t)s.score || taken != (uint64_t)s.score) {
+            return false;
+        }
+        std::vector<char> seen(s.objectCount, 0);
+        for (uint64_t i = 0; i < s.changedCount; i++) {
+            int32_t c = (int32_t)readBytes(file + s.changedOffset + i*4, 4);
+            object o;
+            if (c < 0 || (uint64_t)c >= s.objectCount || seen[c]
+                    || !readObject(file + s.originalOffset + i*OBJECT_BYTES, o) || !placed(o)) {
+                return false;
+            }
+            seen[c] = 1;
+        }
+        for (uint64_t i = 0; i < s.journalLength; i++) {
+            if (file[s.journalOffset + i] > 3) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // restores a map saved by saveTo() from the file it was written to, which must have passed validSave().
+    map(const savedMap& s, const uint8_t* file) : width(s.width), height(s.height) {
+        trace::span t("map");
+        objects.resize(s.objectCount);
+        for (uint64_t i = 0; i < s.objectCount; i++) {
+            readObject(file + s.objectsOffset + i*OBJECT_BYTES, objects[i]);
+        }
+        _setBase();
+        _changed.resize(s.changedCount);
+        _original.resize(s.changedCount);
+        for (uint64_t i = 0; i < s.changedCount; i++) {
+            _changed[i] = (int32_t)readBytes(file + s.changedOffset + i*4, 4);
+            readObject(file + s.originalOffset + i*OBJECT_BYTES, _original[i]);
+            _isChanged[_changed[i]] = 1;
+        }
+        player = s.player;
+        score = s.score;
+        totalScore = s.totalScore;
+        _originalScore = s.originalScore;
+        seed = s.seed;
+        levelHash = s.levelHash;
+        journal.assign(file + s.journalOffset, file + s.journalOffset + s.journalLength);
+    }
+
+    // saves the current position. only the objects that differ from the starting layout are stored.
+    checkpoint save() const {
+        checkpoint cp;
+        cp.changed.reserve(_changed.size());
+        for (int i : _changed) {
+            cp.changed.emplace_back(i, objects[i]);
+        }
+        cp.score = score;
+        cp.journal = journal;
+        return cp;
+    }
+
+    // returns the map to a position saved from it, or from a copy of it, by save().
+    void restore(const checkpoint& cp) {
+        _revert();
+        for (const auto& c : cp.changed) {
+            _unplace(&objects[c.first]);
+            _touch(&objects[c.first]);
+            objects[c.first] = c.second;
+        }
+        // placed once every object is in position, so none are knocked out of the index by another's old cell
+        for (const auto& c : cp.changed) {
+            _place(&objects[c.first]);
+        }
+        _reachDirty = true;
+        score = cp.score;
+        journal = cp.journal;
+    }
+
+    // writes the map as text, one row per line from the top down.
+    // '@' is the player, '$' a box, '.' a target, '*' a captured box, '+' the player on a target and '-' the floor.
+    std::string serialise() const {
+        std::string text;
+        for (int y = height; y > 0; y--) {
+            for (int x = 0; x < width; x++) {
+                int c = _cell(x, y);
+                int m = _movers[c];
+                bool target = _statics[c] != -1 && objects[_statics[c]].capturePoint;
+                if (m == player) {
+                    text += target ? '+' : '@';
+                } else if (m != -1) {
+                    text += objects[m].obstructs ? '*' : '$';
+                } else {
+                    text += target ? '.' : '-';
+                }
+            }
+            if (y > 1) {
+                text += '\n';
+            }
+        }
+        return text;
+    }
+
+    // returns the layout packed the same way for all 8 rotations and reflections of it: the smallest of the 8 as
+    // width and height (u16 each), the player's normalised cell (u32), then every cell in 2 bits, top row first.
+    // the player is normalised to their region, so it does not matter where in it they stand.
+    std::string canonicalLayout() {
+        trace::span t("canonicalLayout");
+        // the contents of every cell, top row first
+        std::string cells(width*height, 0);
+        std::vector<char> region(width*height, 0);
+        for (int r = 0; r < height; r++) {
+            for (int x = 0; x < width; x++) {
+                int c = _cell(x, height - r);
+                int m = _movers[c];
+                bool target = _statics[c] != -1 && objects[_statics[c]].capturePoint;
+                char kind = target ? 1 : 0;
+                if (m != -1 && m != player) {
+                    kind = objects[m].obstructs ? 3 : 2;
+                }
+                cells[r*width + x] = kind;
+                region[r*width + x] = reachable(x, height - r);
+            }
+        }
+        std::string best, packed;
+        std::string transformed(width*height, 0);
+        for (int t = 0; t < 8; t++) {
+            bool flipX = t & 1, flipY = t & 2, swap = t & 4;
+            int tW = swap ? height : width;
+            int tH = swap ? width : height;
+            int playerCell = width*height;
+            for (int r = 0; r < height; r++) {
+                for (int x = 0; x < width; x++) {
+                    int a = flipX ? width-1 - x : x;
+                    int b = flipY ? height-1 - r : r;
+                    int i = swap ? a*tW + b : b*tW + a;
+                    transformed[i] = cells[r*width + x];
+                    if (region[r*width + x]) {
+                        playerCell = std::min(playerCell, i);
+                    }
+                }
+            }
+            packed.assign(8 + (width*height + 3) / 4, 0);
+            for (int i = 0; i < 2; i++) {
+                packed[i] = (tW >> (i*8)) & 0xFF;
+                packed[2 + i] = (tH >> (i*8)) & 0xFF;
+            }
+            for (int i = 0; i < 4; i++) {
+                packed[4 + i] = (playerCell >> (i*8)) & 0xFF;
+            }
+            for (size_t i = 0; i < transformed.size(); i++) {
+                packed[8 + i/4] |= transformed[i] << ((i%4) * 2);
+            }
+            if (t == 0 || packed < best) {
+                best.swap(packed);
+            }
+        }
+        return best;
+    }
+
+    // returns a hash of canonicalLayout(), the same for all 8 rotations and reflections of the layout.
+    uint64_t canonicalHash() {
+        return hashCanonical(canonicalLayout());
+    }
+
+    // hashes a layout returned by canonicalLayout().
+    static uint64_t hashCanonical(const std::string& canonical) {
+        // fnv-1a, then mixed so nearby layouts spread out
+        uint64_t h = _hashText(canonical);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
     }
 
     // draws the map  to a string. a border, represented by the drawing::Hashtag character, is automically placed in around the map.
     const std::string draw() {
+        trace::span t("draw");
         std::string end; // the string to be returned
 
         // add first (top) wall
@@ -167,7 +729,7 @@ struct map {
                 if (o != nullptr) {
                     // if there is an object
                     if (o->render) {
-                        end += o->dchar;
+                        end += drawToString(o->dchar);
                     } else {
                         end += BGD;
                     }
@@ -194,103 +756,234 @@ struct map {
 
     // increments obj's x and y by the values provided. returns true if this was successful, false otherwise.
     // if false is returned, obj is against a wall, or trying to push a box that has already been captured.
+    // the chain of objects in front of obj is resolved in a single walk, nothing is allocated.
     bool move(object* obj, int x = 0, int y = 0) {
-        // check if the new coordinates are out of bounds
-        int nX = obj->x + x;
-        int nY = obj->y + y;
-        if (nY < 1 || nY > height || nX >= width || nX < 0) {
-            return false;
-        }
-
-        // get the object in front of the object
-        object* adjacentObject = find(obj->x+x, obj->y+y);
-
-        // if the object exists, try to move it
-        if (adjacentObject != nullptr) {
-            // if it does not like to be moved, return false
-            if (adjacentObject->obstructs) {
+        trace::span t("move");
+        // walk along the direction until the end of the chain being pushed
+        object* last = obj; // the object at the front of the chain
+        object* captured = nullptr; // the capture point that last lands on, if it is a box
+        int length = 0; // the number of objects pushed along with obj
+        int cX = obj->x + x;
+        int cY = obj->y + y;
+        while (true) {
+            // check if the new coordinates are out of bounds
+            if (cY < 1 || cY > height || cX >= width || cX < 0) {
                 return false;
-            // if it is a background object, ignore
-            } else if (adjacentObject->background) {
-                goto end;
-            // if the adjacent object is a capture point
+            }
+            object* adjacentObject = find(cX, cY);
+            // nothing in the way, the chain can move
+            if (adjacentObject == nullptr || adjacentObject->background) {
+                break;
+            // if it does not like to be moved, nothing moves
+            } else if (adjacentObject->obstructs) {
+                return false;
+            // if the adjacent object is a capture point, the front of the chain moves onto it
             } else if (adjacentObject->capturePoint) {
-                // capture that point!
-                if (obj->captureBox) {
-                    score++;
-                    obj->obstructs = true;
-                    obj->setDrawing(drawing::CheckMark); // change to differentiate
-                    remove(adjacentObject); // get rid of the checkpoint
-                }
-            // otherwise, try to move the object
-            } else {
-                bool success = move(adjacentObject, x, y);
-                // if the object could not be moved, don't move with it!
-                if (!success) {
-                    return false;
+                if (last->captureBox) {
+                    captured = adjacentObject;
                 }
+                break;
             }
+            // otherwise it gets pushed along too
+            last = adjacentObject;
+            length++;
+            cX += x;
+            cY += y;
+        }
+
+        // capture that point!
+        if (captured != nullptr) {
+            score++;
+            _touch(last);
+            last->obstructs = true;
+            last->setDrawing(drawing::CheckMark); // change to differentiate
+            remove(captured); // get rid of the checkpoint
+        }
+
+        // the player's region only changes when something other than obj moves
+        if (length > 0 || captured != nullptr) {
+            _reachDirty = true;
         }
 
+        // shift the pushed objects forwards, starting from the front of the chain
+        for (int i = length; i > 0; i--) {
+            int from = _cell(obj->x + x*i, obj->y + y*i);
+            int to = _cell(obj->x + x*(i+1), obj->y + y*(i+1));
+            _movers[to] = _movers[from];
+            _movers[from] = -1;
+            _touch(&objects[_movers[to]]);
+            objects[_movers[to]].x += x;
+            objects[_movers[to]].y += y;
+        }
         // if all goes swell, increment the obj's coordinates
-        end:
+        _touch(obj);
+        _unplace(obj);
         obj->x += x;
         obj->y += y;
+        _place(obj);
+        return true;
+    }
+
+    // moves obj by the values provided up to count times, stopping at the first move that fails.
+    // returns the number of moves that succeeded.
+    // the player's moves are added to the journal.
+    int moveRun(object* obj, int x, int y, int count) {
+        int moved = 0;
+        while (moved < count && move(obj, x, y)) {
+            moved++;
+        }
+        int direction = directionCode(x, y);
+        if (obj == &objects[player] && direction != -1) {
+            journal.insert(journal.end(), moved, direction);
+        }
+        return moved;
+    }
+
+    // plays a string of moves for the player, such as "wwd" or "d20w3" where a number repeats the key before it.
+    // unknown characters are skipped. returns the number of moves that succeeded.
+    int play(const std::string& keys) {
+        int moved = 0;
+        for (size_t i = 0; i < keys.size(); i++) {
+            int x, y;
+            if (!keyToDirection(keys[i], x, y)) {
+                continue;
+            }
+            int count = 0;
+            while (i+1 < keys.size() && keys[i+1] >= '0' && keys[i+1] <= '9') {
+                count = count*10 + (keys[++i] - '0');
+            }
+            moved += moveRun(&objects[player], x, y, count == 0 ? 1 : count);
+        }
+        return moved;
+    }
+
+    // returns true if the player can walk to (x, y) without pushing anything.
+    bool reachable(int x, int y) {
+        if (y < 1 || y > height || x >= width || x < 0) {
+            return false;
+        }
+        if (_reachDirty) {
+            _flood();
+        }
+        return _reach[_cell(x, y)];
+    }
+
+    // returns the lowest cell index the player can walk to.
+    // two positions with the same box layout and normalised player can reach exactly the same states.
+    int normalisedPlayer() {
+        if (_reachDirty) {
+            _flood();
+        }
+        return _reachMin;
+    }
+
+    // returns the keys of the shortest walk from the player to (x, y) that pushes nothing.
+    // the string is empty if (x, y) cannot be reached or the player is already there.
+    std::string pathTo(int x, int y) {
+        std::string path;
+        if (!reachable(x, y)) {
+            return path;
+        }
+        // breadth first search from the target, so following _from leads forwards to it
+        const object& p = objects[player];
+        int start = _cell(p.x, p.y);
+        int goal = _cell(x, y);
+        _from.assign(width*height, -1);
+        _queue.clear();
+        _queue.push_back(goal);
+        _from[goal] = goal;
+        for (size_t i = 0; i < _queue.size() && _from[start] == -1; i++) {
+            int c = _queue[i];
+            int cX = c % width;
+            const int next[4] = { cX > 0 ? c-1 : -1, cX < width-1 ? c+1 : -1, c >= width ? c-width : -1, c+width < width*height ? c+width : -1 };
+            for (int n : next) {
+                if (n != -1 && _from[n] == -1 && _reach[n]) {
+                    _from[n] = c;
+                    _queue.push_back(n);
+                }
+            }
+        }
+        for (int c = start; c != goal; c = _from[c]) {
+            int step = _from[c] - c;
+            path += step == 1 ? 'd' : step == -1 ? 'a' : step == width ? 'w' : 's';
+        }
+        return path;
+    }
+
+    // walks the player to (x, y) along the shortest path that pushes nothing.
+    // returns false if (x, y) cannot be reached.
+    bool goTo(int x, int y) {
+        if (!reachable(x, y)) {
+            return false;
+        }
+        play(pathTo(x, y));
         return true;
     }
 
     // finds and returns a pointer to the object with the matching x and y values.
     // if the object cannot be found, a nullptr is returned.
     object* find(int x, int y) {
-        for (auto& obj : objects) {
-            if (obj.x == x && obj.y == y) {
-                return &obj;
+        // removed objects live out of bounds, so only they need the slow path
+        if (y < 1 || y > height || x >= width || x < 0) {
+            for (auto& obj : objects) {
+                if (obj.x == x && obj.y == y) {
+                    return &obj;
+                }
             }
+            return nullptr;
         }
-        return nullptr;
+        int c = _cell(x, y);
+        int i = _movers[c] != -1 ? _movers[c] : _statics[c];
+        return i == -1 ? nullptr : &objects[i];
     }
 
     // moves the object to the back of the stack, but always above the score flags.
     void push(object* obj) {
         int firstBox = -1;
-        int moveObj;
         for (int i = 0; i < objects.size(); i++) {
-            if (objects[i].captureBox && firstBox == -1) {
+            if (objects[i].captureBox) {
                 firstBox = i;
-            }
-            if (&(objects[i]) == obj) {
-                moveObj = i;
+                break;
             }
         }
-        if (firstBox == moveObj) {
+        if (firstBox == -1 || &objects[firstBox] == obj) {
             return;
         } else {
-            // swap values
+            // swap values, the objects may change layers in the index
+            _unplace(&objects[firstBox]);
+            _unplace(obj);
+            _touch(&objects[firstBox]);
+            _touch(obj);
             objects[firstBox].swap(obj);
+            _place(&objects[firstBox]);
+            _place(obj);
+            _reachDirty = true;
         }
     }
 
-    // finds the index of and removes the provided object.
+    // removes the provided object.
     // not actually "removing" the object, just setting its x and ys out of proper map range.
     bool remove(object* obj) {
-        for (int i = 0; i < objects.size(); i++) {
-            if (&(objects[i]) == obj) {
-                // move the object out of bounds forcefully
-                objects[i].render = false;
-                objects[i].x = width*4;
-                objects[i].y = height*4;
-                return true;
-            }
+        if (obj < objects.data() || obj >= objects.data() + objects.size()) {
+            return false;
         }
-        return false;
+        _unplace(obj);
+        _touch(obj);
+        _reachDirty = true;
+        // move the object out of bounds forcefully
+        obj->render = false;
+        obj->x = width*4;
+        obj->y = height*4;
+        return true;
     }
 
     // generates an instance of an object, assigning x and y values where they are available and not used by another object.
     object autoObject(drawing dc) {
+        trace::span t("autoObject");
         // generate x and y values
         int x, y;
-        x = rand() % width;
-        y = rand() % height;
+        x = _random() % width;
+        y = _random() % height;
         
         // if x or y are out of bounds
         if (x < 1 || x >= width-1 || y > height-1 || y < 2) {
@@ -309,7 +1002,9 @@ struct map {
         return object(x, y, dc);
     }
 
-    map(int w = 10, int h = 10) : width(w), height(h) {
+    map(int w = 10, int h = 10, uint64_t s = randomSeed()) : width(w), height(h), seed(s) {
+        trace::span t("map");
+        _rngState = seed;
         // generate the player
         objects.push_back(autoObject(drawing::Smiley));
         player = 0;
@@ -319,6 +1014,7 @@ struct map {
         if (totalScore == 0) {
             totalScore = w; // last resort, anyone making a fork of the game won't be this stupid...
         }
+        objects.reserve(totalScore*2 + 1);
         // auto-generate boxes and targets
         for (int i = 1; i < totalScore+1; i++) {
             objects.push_back(autoObject(drawing::Cross)); // target
@@ -330,44 +1026,1396 @@ struct map {
         }
 
         // original objects in case of reset()
-        _originalObjects = objects;
+        _setBase();
+        levelHash = _hashText(serialise());
+    }
+
+    // returns true if layout can be loaded by map(layout): it is not empty, has exactly one player
+    // and only uses the characters written by serialise().
+    static bool validLayout(const std::string& layout) {
+        int players = 0;
+        for (char ch : layout) {
+            if (ch == '@' || ch == '+') {
+                players++;
+            } else if (std::string("$.*-\n").find(ch) == std::string::npos) {
+                return false;
+            }
+        }
+        return players == 1;
+    }
+
+    // loads a map from text in the format written by serialise(). layout must pass validLayout().
+    explicit map(const std::string& layout) : width(layouts::size(layout).first), height(layouts::size(layout).second) {
+        trace::span t("map");
+        // objects keep the usual order: the player, then targets, then boxes
+        std::vector<object> boxes;
+        objects.push_back(object());
+        player = 0;
+        int x = 0, y = height;
+        for (char ch : layout) {
+            if (ch == '\n') {
+                x = 0;
+                y--;
+                continue;
+            }
+            if (ch == '@' || ch == '+') {
+                objects[player] = object(x, y, drawing::Smiley);
+            }
+            if (ch == '.' || ch == '+' || ch == '*') {
+                objects.push_back(object(x, y, drawing::Cross));
+                objects.back().capturePoint = true;
+            }
+            if (ch == '$' || ch == '*') {
+                boxes.push_back(object(x, y, drawing::FullBox));
+                boxes.back().captureBox = true;
+            }
+            if (ch == '*') {
+                // already captured, so the target is gone
+                objects.back().render = false;
+                objects.back().x = width*4;
+                objects.back().y = height*4;
+                boxes.back().obstructs = true;
+                boxes.back().setDrawing(drawing::CheckMark);
+                _originalScore++;
+            }
+            x++;
+        }
+        totalScore = objects.size() - 1;
+        objects.insert(objects.end(), boxes.begin(), boxes.end());
+        score = _originalScore;
+
+        _setBase();
+        levelHash = _hashText(serialise());
     }
 };
 
-// contains all of the game data.
-struct boxpush {
-    std::vector<map> maps;
-    int mapIndex = 0;
+// a set of strings indexed by 64-bit hashes of them, open-addressed so millions fit in a flat array.
+// strings with the same hash are still told apart, so a collision never loses one.
+struct hashset {
+    std::vector<uint64_t> slots; // 0 marks an empty slot
+    std::vector<uint32_t> indices; // where in keys the string of each slot is
+    std::vector<std::string> keys;
+    size_t count = 0;
+    size_t collisions = 0; // strings that shared a hash with a different string
 
-    // returns a reference to the map at the current map index.
-    map& currentMap() {
-        return maps[mapIndex];
+    // adds key, whose hash is h, returns false if it was already present.
+    bool insert(uint64_t h, std::string key) {
+        h = h == 0 ? 1 : h;
+        if ((count+1)*2 > slots.size()) {
+            _grow();
+        }
+        size_t mask = slots.size() - 1;
+        bool collided = false;
+        for (size_t i = h & mask; ; i = (i+1) & mask) {
+            if (slots[i] == h && keys[indices[i]] == key) {
+                return false;
+            } else if (slots[i] == h) {
+                collided = true;
+            } else if (slots[i] == 0) {
+                slots[i] = h;
+                indices[i] = keys.size();
+                keys.push_back(std::move(key));
+                count++;
+                collisions += collided;
+                return true;
+            }
+        }
     }
 
-    boxpush(std::initializer_list<map> ms) : maps(ms) { srand(time(0)); }
+    private:
+    void _grow() {
+        std::vector<uint64_t> old;
+        std::vector<uint32_t> oldIndices;
+        old.swap(slots);
+        oldIndices.swap(indices);
+        slots.assign(std::max<size_t>(1024, old.size()*2), 0);
+        indices.assign(slots.size(), 0);
+        size_t mask = slots.size() - 1;
+        for (size_t j = 0; j < old.size(); j++) {
+            if (old[j] == 0) {
+                continue;
+            }
+            size_t i = old[j] & mask;
+            while (slots[i] != 0) {
+                i = (i+1) & mask;
+            }
+            slots[i] = old[j];
+            indices[i] = oldIndices[j];
+        }
+    }
 };
 
-int main(int argc, char ** argv) {
-    // check if any game modifiers have been passed
-    argh::parser parser;
-    parser.add_params({
-        "--map", // <width,height>
-        "--override-player", // <text>
-        "--override-box", // <text>
-        "--override-target", // <text>
-        "--override-border", // <text>
-        "--override-background", // <text>
-        "--override-tick", // <text>
-    });
+// reads the next level of a pack into layout. levels are separated by blank lines and lines starting with ';' are comments.
+// returns false once the pack has no more levels.
+bool readLevel(std::istream& in, std::string& layout) {
+    layout.clear();
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty() && line[0] == ';') {
+            continue;
+        } else if (line.empty()) {
+            if (!layout.empty()) {
+                break;
+            }
+            continue;
+        }
+        if (!layout.empty()) {
+            layout += '\n';
+        }
+        layout += line;
+    }
+    return !layout.empty();
+}
 
-    // if these have a value above -1, then --map has been passed
-    int optionalWidth = -1;
-    int optionalHeight = -1;
+// writes count randomly generated width x height levels to out as a pack.
+void generatePack(std::ostream& out, int count, int width, int height) {
+    for (int i = 0; i < count; i++) {
+        out << map(width, height).serialise() << "\n\n";
+    }
+}
 
-    // parse arguments
-    parser.parse(argv);
-    for (const auto& argCouple : parser.params()) {
-        if (argCouple.first == "map") {
+// writes the levels of the pack at path to out, leaving out any that are a rotation or reflection of an earlier level.
+// levels are streamed through in chunks and hashed in parallel, so only the packed canonical forms of unique levels are kept.
+int dedupPack(const std::string& path, std::ostream& out) {
+    std::ifstream in(path);
+    if (!in) {
+        return fatal("Could not open the pack '" + path + "'.");
+    }
+    const size_t CHUNK = 1 << 16;
+    pool workers;
+    hashset seen;
+    std::vector<std::string> layouts(CHUNK);
+    std::vector<uint64_t> hashes(CHUNK);
+    std::vector<std::string> canonical(CHUNK);
+    size_t total = 0, invalid = 0;
+    auto started = std::chrono::steady_clock::now();
+    while (true) {
+        size_t n = 0;
+        while (n < CHUNK && readLevel(in, layouts[n])) {
+            n++;
+        }
+        if (n == 0) {
+            break;
+        }
+        workers.run(n, [&](size_t i) {
+            if (map::validLayout(layouts[i])) {
+                map m(layouts[i]);
+                canonical[i] = m.canonicalLayout();
+                hashes[i] = map::hashCanonical(canonical[i]);
+            } else {
+                hashes[i] = 0;
+            }
+        });
+        // kept in order, so the first of every set of duplicates survives
+        for (size_t i = 0; i < n; i++) {
+            if (hashes[i] == 0 && !map::validLayout(layouts[i])) {
+                invalid++;
+            } else if (seen.insert(hashes[i], std::move(canonical[i]))) {
+                out << layouts[i] << "\n\n";
+            }
+        }
+        total += n;
+    }
+    out << std::flush;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::cerr << total << " levels, " << seen.count << " unique, " << total - seen.count - invalid << " duplicates, "
+        << invalid << " invalid, " << seen.collisions << " hash collisions (" << (size_t)(total / std::max(seconds, 1e-9)) << " levels/s)" << std::endl;
+    return 0;
+}
+
+// the number of states a single search may store before giving up, unless --node-limit is passed.
+const size_t DEFAULT_NODE_LIMIT = 1 << 18;
+// the memory all searches running at once may take up between them, in megabytes, unless --tt-mb is passed.
+const size_t DEFAULT_SEARCH_MB = 512;
+// while playing, hints and the checks of endless levels may search at once. hints take this fraction of the memory,
+// and endless levels a far smaller one, as their searches stop after a few thousand nodes.
+const size_t HINT_SHARE = 4, ENDLESS_SHARE = 64;
+
+// measures transposition table stores and probes per second with 1 to 64 threads, in a table of megabytes.
+int benchTable(std::ostream& out, size_t megabytes) {
+    tt::table table(megabytes);
+    // enough keys to fill the table, so the later rounds measure replacement as well as empty slots
+    const size_t keys = table.capacity();
+    out << "table: " << table.bytes() / (1024*1024) << " MB, " << table.capacity() << " entries\n";
+    out << "threads,stores_per_second,probes_per_second,hit_rate\n";
+    for (unsigned threads = 1; threads <= 64; threads *= 2) {
+        table.clear();
+        table.age();
+        auto run = [&](bool store, std::atomic<size_t>& hits) {
+            std::vector<std::thread> workers;
+            auto started = std::chrono::steady_clock::now();
+            for (unsigned t = 0; t < threads; t++) {
+                workers.emplace_back([&, t]() {
+                    size_t found = 0;
+                    // each thread takes its own slice of the keys, hashed so they spread over the table
+                    for (size_t i = t; i < keys; i += threads) {
+                        uint64_t k = (i + 1) * 0x9e3779b97f4a7c15ULL;
+                        k ^= k >> 31;
+                        tt::entry e;
+                        if (store) {
+                            table.store(k, i & 0xFFFF, i);
+                        } else if (table.probe(k, e) && e.value == i) {
+                            found++;
+                        }
+                    }
+                    hits += found;
+                });
+            }
+            for (auto& w : workers) {
+                w.join();
+            }
+            return keys / std::max(std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count(), 1e-9);
+        };
+        std::atomic<size_t> hits{0};
+        double stores = run(true, hits);
+        double probes = run(false, hits);
+        char row[128];
+        snprintf(row, sizeof(row), "%u,%.0f,%.0f,%.3f\n", threads, stores, probes, (double)hits / keys);
+        out << row << std::flush;
+    }
+    return 0;
+}
+
+// writes difficulty metrics for every level of the pack at path to out as csv, one row per level in pack order.
+// levels are searched in parallel, a chunk at a time so the pack never has to fit in memory.
+// the searches share megabytes of memory between them.
+int analysePack(const std::string& path, std::ostream& out, size_t nodeLimit, size_t megabytes) {
+    std::ifstream in(path);
+    if (!in) {
+        return fatal("Could not open the pack '" + path + "'.");
+    }
+    pool workers;
+    const size_t CHUNK = workers.size() * 16;
+    std::vector<std::string> layouts(CHUNK), rows(CHUNK);
+    size_t level = 0;
+    out << "level,width,height,boxes,targets,total_score,box_target_ratio,dead_squares,tunnel_cells,goal_rooms,solved,min_pushes,min_moves,box_moves_bound,min_box_moves,nodes_expanded,branching_factor,seconds\n";
+    while (true) {
+        size_t n = 0;
+        while (n < CHUNK && readLevel(in, layouts[n])) {
+            n++;
+        }
+        if (n == 0) {
+            break;
+        }
+        workers.run(n, [&](size_t i) {
+            trace::span t("analyse");
+            std::string& row = rows[i];
+            row = std::to_string(level + i + 1);
+            if (!map::validLayout(layouts[i])) {
+                row += ",invalid\n";
+                return;
+            }
+            auto started = std::chrono::steady_clock::now();
+            search::puzzle p(layouts[i]);
+            // every thread keeps its workspace from level to level, so searching does not go back to malloc
+            thread_local std::unique_ptr<search::workspace> w;
+            if (!w) {
+                w.reset(new search::workspace(std::max<size_t>(1, megabytes / workers.size())));
+            }
+            search::solver s(p, nodeLimit, *w);
+            // the fewest pushes and the fewest moves usually come from different solutions, so both are searched
+            search::result pushes = s.pushes();
+            search::result moves = pushes.solved ? s.moves() : search::result();
+            // the best first search settles most levels the breadth first ones give up on
+            int bound = s.lowerBound();
+            search::result boxes = s.bounded();
+            bool solvable = pushes.solved || boxes.solved;
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            // targets are those still open, the total score also counts the boxes captured from the start
+            char buf[256];
+            snprintf(buf, sizeof(buf), ",%d,%d,%d,%d,%d,%.3f,%d,%d,%d,%s,%s,%s,%s,%s,%zu,%.3f,%.4f\n",
+                p.width, p.height, p.boxCount, search::count(p.targets.data(), p.words), p.totalScore, p.totalScore == 0 ? 0.0 : (double)p.boxCount / p.totalScore,
+                p.deadCount, p.tunnelCount, p.goalRoomCount,
+                solvable ? "yes" : pushes.exhausted && boxes.exhausted ? "unknown" : "no",
+                pushes.solved ? std::to_string(pushes.pushes).c_str() : "",
+                moves.solved ? std::to_string(moves.moves).c_str() : "",
+                bound != -1 ? std::to_string(bound).c_str() : "",
+                boxes.solved ? std::to_string(boxes.boxMoves).c_str() : "",
+                pushes.expanded, pushes.branching(), seconds);
+            row += buf;
+        });
+        for (size_t i = 0; i < n; i++) {
+            out << rows[i];
+        }
+        out << std::flush;
+        level += n;
+    }
+    return 0;
+}
+
+// writes the moves the player made to solve m as a replay in dir.
+bool recordReplay(const map& m, const std::string& dir) {
+    replay::header h;
+    h.width = m.width;
+    h.height = m.height;
+    h.seed = m.seed;
+    h.levelHash = m.levelHash;
+    std::vector<uint8_t> data;
+    replay::write(data, h, m.journal);
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx-%lld.bxr", (unsigned long long)m.levelHash,
+        (long long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    std::ofstream out(std::filesystem::path(dir) / name, std::ios::binary);
+    out.write((const char*)data.data(), data.size());
+    return out.good();
+}
+
+// checks every replay in the files under dir by regenerating its level from the seed and playing it through map::move.
+// a replay is valid if it solves the level with its last move. invalid replays are listed on out.
+int verifyReplays(const std::string& dir, std::ostream& out) {
+    std::vector<std::filesystem::path> files;
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(dir, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if (it->is_regular_file()) {
+            files.push_back(it->path());
+        }
+    }
+    if (ec) {
+        return fatal("Could not read the replays in '" + dir + "'.");
+    }
+
+    pool workers;
+    std::mutex outLock;
+    std::atomic<size_t> replays{0}, invalid{0}, moves{0};
+    auto started = std::chrono::steady_clock::now();
+    workers.run(files.size(), [&](size_t f) {
+        // levels are regenerated once per thread and reset for each replay that uses them
+        thread_local std::map<std::tuple<int, int, uint64_t>, map> levels;
+        std::ifstream in(files[f], std::ios::binary);
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::vector<uint8_t> decoded;
+        std::string report;
+        if (!in.is_open() || in.bad()) {
+            report += files[f].string() + ": could not be read\n";
+            invalid++;
+        }
+        size_t at = 0;
+        int index = 0;
+        // a file may hold any number of replays back to back
+        while (at < data.size()) {
+            replay::header h;
+            const char * problem = nullptr;
+            if (!replay::readHeader(data.data() + at, data.size() - at, h)) {
+                report += files[f].string() + "#" + std::to_string(index) + ": malformed header\n";
+                invalid++;
+                break;
+            }
+            if (!replay::decode(data.data() + at + replay::HEADER_SIZE, h.bytes, h.moves, decoded)) {
+                problem = "malformed moves";
+            } else if (h.width < 4 || h.height < 4 || h.seed == 0) {
+                problem = "not a generated level";
+            } else {
+                if (levels.size() > 1024) {
+                    levels.clear();
+                }
+                auto key = std::make_tuple((int)h.width, (int)h.height, h.seed);
+                auto found = levels.find(key);
+                if (found == levels.end()) {
+                    found = levels.emplace(key, map(h.width, h.height, h.seed)).first;
+                }
+                map& m = found->second;
+                m.reset();
+                if (m.levelHash != h.levelHash) {
+                    problem = "level does not match its hash";
+                } else {
+                    // levels of the common sizes are played on a fixed-size board, the rest on the map itself
+                    size_t played = 0;
+                    bool solved = false;
+                    bool fast = boards::fits(m.width, m.height) && withBoard(m.serialise(), [&](auto&& b) {
+                        played = b.play(decoded.data(), decoded.size());
+                        solved = b.solved();
+                    });
+                    if (!fast) {
+                        for (; played < decoded.size() && m.score != m.totalScore; played++) {
+                            int x, y;
+                            keyToDirection(replay::toKey(decoded[played]), x, y);
+                            m.move(&m.objects[m.player], x, y);
+                        }
+                        solved = m.score == m.totalScore;
+                    }
+                    if (played < decoded.size()) {
+                        problem = "moves after the level was solved";
+                    } else if (!solved) {
+                        problem = "does not solve the level";
+                    }
+                }
+                moves += decoded.size();
+            }
+            if (problem != nullptr) {
+                report += files[f].string() + "#" + std::to_string(index) + ": " + problem + "\n";
+                invalid++;
+            }
+            replays++;
+            index++;
+            at += replay::HEADER_SIZE + h.bytes;
+        }
+        if (!report.empty()) {
+            std::lock_guard<std::mutex> lock(outLock);
+            out << report;
+        }
+    });
+    out << std::flush;
+    double seconds = std::max(std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count(), 1e-9);
+    std::cerr << replays << " replays in " << files.size() << " files, " << invalid << " invalid ("
+        << (size_t)(replays / seconds) << " replays/s, " << (size_t)(moves / seconds) << " moves/s)" << std::endl;
+    return invalid > 0 ? 1 : 0;
+}
+
+// the largest side of a level --fuzz makes up, so that any state fits in a few words
+const int FUZZ_MAX_SIDE = 12;
+const int FUZZ_WORDS = (FUZZ_MAX_SIDE * FUZZ_MAX_SIDE + 63) / 64;
+
+// a level as every engine can report it, compared between them after every move.
+struct fuzzState {
+    bool moved = false; // did the move succeed?
+    bool indexed = true; // does the map's cell index agree with its objects? always true for the other engines
+    int player = -1;
+    int region = -1; // the lowest cell the player can walk to
+    int score = 0;
+    uint64_t boxes[FUZZ_WORDS] = {}, captured[FUZZ_WORDS] = {}, targets[FUZZ_WORDS] = {};
+
+    bool operator==(const fuzzState& o) const {
+        return moved == o.moved && indexed == o.indexed && player == o.player && region == o.region && score == o.score
+            && std::equal(boxes, boxes + FUZZ_WORDS, o.boxes)
+            && std::equal(captured, captured + FUZZ_WORDS, o.captured)
+            && std::equal(targets, targets + FUZZ_WORDS, o.targets);
+    }
+
+    // the state in the format written by map::serialise(), followed by anything that does not show in it.
+    std::string text(int width, int height) const {
+        std::string out;
+        for (int y = height; y > 0; y--) {
+            for (int x = 0; x < width; x++) {
+                int c = (y-1)*width + x;
+                bool target = search::test(targets, c);
+                out += c == player ? (target ? '+' : '@')
+                    : search::test(captured, c) ? '*'
+                    : search::test(boxes, c) ? '$'
+                    : target ? '.' : '-';
+            }
+            out += '\n';
+        }
+        out += "score " + std::to_string(score) + ", region " + std::to_string(region) + (moved ? ", moved" : ", blocked") + (indexed ? "" : ", cell index out of date");
+        return out;
+    }
+};
+
+// reads the state of the reference engine, the map.
+fuzzState fuzzRead(map& m, bool moved) {
+    fuzzState s;
+    s.moved = moved;
+    s.score = m.score;
+    s.region = m.normalisedPlayer();
+    for (size_t i = 0; i < m.objects.size(); i++) {
+        object& o = m.objects[i];
+        // removed objects live out of bounds
+        if (o.y < 1 || o.y > m.height || o.x < 0 || o.x >= m.width) {
+            continue;
+        }
+        int c = (o.y-1)*m.width + o.x;
+        if ((int)i == m.player) {
+            s.player = c;
+        } else if (o.captureBox) {
+            search::set(o.obstructs ? s.captured : s.boxes, c);
+        } else if (o.capturePoint) {
+            search::set(s.targets, c);
+        }
+        // whatever moves is found before what it stands on
+        if (!o.capturePoint && !o.background && m.find(o.x, o.y) != &o) {
+            s.indexed = false;
+        }
+    }
+    return s;
+}
+
+// the first move after which an engine disagrees with the map, if any. step is -1 for a level whose
+// rotations and reflections disagree before anything moves.
+struct fuzzDifference {
+    long step = -1;
+    std::string engine, expected, got;
+};
+
+// layout turned by one of the 8 rotations and reflections, numbered as in map::canonicalLayout().
+std::string fuzzTransform(const std::string& layout, int t) {
+    std::vector<std::string> rows(1);
+    for (char ch : layout) {
+        if (ch == '\n') {
+            rows.emplace_back();
+        } else {
+            rows.back() += ch;
+        }
+    }
+    if (rows.back().empty()) {
+        rows.pop_back();
+    }
+    bool flipX = t & 1, flipY = t & 2, swap = t & 4;
+    int width = rows[0].size(), height = rows.size();
+    std::vector<std::string> out(swap ? width : height, std::string(swap ? height : width, '-'));
+    for (int r = 0; r < height; r++) {
+        for (int x = 0; x < width; x++) {
+            int a = flipX ? width-1 - x : x;
+            int b = flipY ? height-1 - r : r;
+            (swap ? out[a][b] : out[b][a]) = rows[r][x];
+        }
+    }
+    std::string text;
+    for (size_t i = 0; i < out.size(); i++) {
+        text += (i > 0 ? "\n" : "") + out[i];
+    }
+    return text;
+}
+
+// stands in for a board when the level is not a size one is compiled for.
+struct noBoard {};
+
+// plays moves on layout with every engine, comparing them after each one. returns the number of moves played,
+// which is fewer than moves.size() if they disagreed, in which case d is filled in when given.
+template<typename B>
+size_t fuzzPlay(const std::string& layout, const std::vector<uint8_t>& moves, B& b, fuzzDifference* d) {
+    map m(layout);
+    search::puzzle p(layout);
+    std::vector<uint64_t> bits = p.start;
+    int player = p.player;
+    search::walker walk;
+    int region = walk.flood(p, bits.data(), player);
+    for (size_t i = 0; i < moves.size(); i++) {
+        int x, y, pushed;
+        keyToDirection(replay::toKey(moves[i]), x, y);
+        fuzzState expected = fuzzRead(m, m.move(&m.objects[m.player], x, y));
+
+        int next = search::step(p, bits.data(), player, moves[i], pushed);
+        player = next == -1 ? player : next;
+        // the region only changes when a box moves, which is what the map's cache has to notice
+        if (next != -1 && pushed > 0) {
+            region = walk.flood(p, bits.data(), player);
+        }
+        fuzzState got;
+        got.moved = next != -1;
+        got.player = player;
+        got.region = region;
+        got.score = search::count(bits.data() + p.words, p.words);
+        for (int w = 0; w < p.words; w++) {
+            got.boxes[w] = bits[w];
+            got.captured[w] = bits[w + p.words];
+            got.targets[w] = p.targets[w] & ~bits[w + p.words];
+        }
+        std::string engine = "search::step";
+
+        if constexpr (!std::is_same<B, noBoard>::value) {
+            if (got == expected) {
+                got = fuzzState();
+                got.moved = b.move(moves[i]);
+                got.player = b.player();
+                got.region = expected.region; // boards leave normalising the player to the searches
+                got.score = b.score();
+                for (int w = 0; w < B::WORDS; w++) {
+                    got.boxes[w] = b.boxes()[w];
+                    got.captured[w] = b.captured()[w];
+                    got.targets[w] = b.targets()[w];
+                }
+                engine = "board<" + std::to_string(B::WIDTH) + ", " + std::to_string(B::HEIGHT) + ">";
+            }
+        }
+
+        if (!(got == expected)) {
+            if (d != nullptr) {
+                d->step = i;
+                d->engine = engine;
+                d->expected = expected.text(m.width, m.height);
+                d->got = got.text(m.width, m.height);
+            }
+            return i;
+        }
+    }
+    return moves.size();
+}
+
+// returns true if a rotation or reflection of layout gets another canonical hash, filling in d when given.
+bool fuzzSymmetry(const std::string& layout, fuzzDifference* d) {
+    map m(layout);
+    uint64_t canonical = m.canonicalHash();
+    for (int t = 1; t < 8; t++) {
+        std::string turned = fuzzTransform(layout, t);
+        map other(turned);
+        if (other.canonicalHash() != canonical) {
+            if (d != nullptr) {
+                d->step = -1;
+                d->engine = "map::canonicalHash";
+                d->expected = m.serialise() + "\nhash " + std::to_string(canonical);
+                d->got = turned + "\nhash " + std::to_string(other.canonicalHash());
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// returns true if any engine disagrees with the map while playing moves on layout, or the level's canonical hash
+// depends on which way round it is.
+bool fuzzCase(const std::string& layout, const std::vector<uint8_t>& moves, fuzzDifference* d = nullptr) {
+    if (fuzzSymmetry(layout, d)) {
+        return true;
+    }
+    bool differs = false;
+    bool fast = withBoard(layout, [&](auto&& b) {
+        differs = fuzzPlay(layout, moves, b, d) < moves.size();
+    });
+    if (!fast) {
+        noBoard none;
+        differs = fuzzPlay(layout, moves, none, d) < moves.size();
+    }
+    return differs;
+}
+
+// makes up a level of any mix of boxes, captured boxes and targets, unlike generated levels which keep to a pattern.
+std::string fuzzLevel(std::mt19937_64& rng, int width, int height) {
+    std::string layout;
+    int player = rng() % (width*height);
+    for (int c = 0; c < width*height; c++) {
+        int r = rng() % 100;
+        char ch = r < 55 ? '-' : r < 75 ? '$' : r < 92 ? '.' : '*';
+        if (c == player) {
+            ch = ch == '.' ? '+' : '@';
+        }
+        layout += ch;
+        if (c % width == width-1 && c != width*height-1) {
+            layout += '\n';
+        }
+    }
+    return layout;
+}
+
+// layout without its first or last row or column (side 0 to 3), or an empty string if that leaves no valid level.
+std::string fuzzTrim(const std::string& layout, int side) {
+    std::vector<std::string> rows(1);
+    for (char ch : layout) {
+        if (ch == '\n') {
+            rows.emplace_back();
+        } else {
+            rows.back() += ch;
+        }
+    }
+    if (side < 2 && rows.size() > 1) {
+        rows.erase(side == 0 ? rows.begin() : rows.end() - 1);
+    } else if (side >= 2 && rows[0].size() > 1) {
+        for (auto& row : rows) {
+            row.erase(side == 2 ? row.begin() : row.end() - 1);
+        }
+    } else {
+        return "";
+    }
+    std::string out;
+    for (size_t i = 0; i < rows.size(); i++) {
+        out += (i > 0 ? "\n" : "") + rows[i];
+    }
+    return map::validLayout(out) ? out : "";
+}
+
+// shrinks a failing case until no single move, object, row or column can be taken away and it still fails.
+void fuzzShrink(std::string& layout, std::vector<uint8_t>& moves) {
+    bool shrunk = true;
+    while (shrunk) {
+        shrunk = false;
+        // nothing after the first difference matters
+        fuzzDifference d;
+        fuzzCase(layout, moves, &d);
+        moves.resize(d.step + 1);
+        // take out runs of moves, halving their length down to single moves
+        for (size_t run = std::max<size_t>(moves.size() / 2, 1); run > 0; run /= 2) {
+            for (size_t i = moves.size() >= run ? moves.size() - run + 1 : 0; i-- > 0; ) {
+                std::vector<uint8_t> fewer = moves;
+                fewer.erase(fewer.begin() + i, fewer.begin() + std::min(i + run, fewer.size()));
+                if (fuzzCase(layout, fewer)) {
+                    moves = fewer;
+                    shrunk = true;
+                    i = std::min(i, moves.size() >= run ? moves.size() - run + 1 : 0);
+                }
+            }
+        }
+        for (int side = 0; side < 4; side++) {
+            std::string smaller = fuzzTrim(layout, side);
+            while (!smaller.empty() && fuzzCase(smaller, moves)) {
+                layout = smaller;
+                smaller = fuzzTrim(layout, side);
+                shrunk = true;
+            }
+        }
+        // empty cells one at a time, a player on a target steps off it
+        for (size_t i = 0; i < layout.size(); i++) {
+            if (std::string("$*.+").find(layout[i]) == std::string::npos) {
+                continue;
+            }
+            std::string simpler = layout;
+            simpler[i] = layout[i] == '+' ? '@' : '-';
+            if (fuzzCase(simpler, moves)) {
+                layout = simpler;
+                shrunk = true;
+            }
+        }
+    }
+}
+
+// plays random moves on random levels for the given time on every core, checking the optimised engines (search::step
+// and the fixed-size boards) against map::move after every move, and search::walker's normalised player against
+// map::normalisedPlayer(). each level's canonical hash is checked against those of its rotations and reflections.
+// the first difference found is shrunk and written to out.
+int fuzzEngines(std::ostream& out, double seconds) {
+    pool workers;
+    std::atomic<bool> found{false};
+    std::atomic<size_t> levels{0}, moves{0};
+    std::mutex foundLock;
+    std::string failedLayout;
+    std::vector<uint8_t> failedMoves;
+    auto started = std::chrono::steady_clock::now();
+    auto deadline = started + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+    uint64_t seed = randomSeed();
+    workers.run(workers.size(), [&](size_t t) {
+        std::mt19937_64 rng(seed + t * 0x9e3779b97f4a7c15ULL);
+        std::vector<uint8_t> sequence;
+        size_t played = 0, made = 0;
+        while (!found && std::chrono::steady_clock::now() < deadline) {
+            int width = 4 + rng() % (FUZZ_MAX_SIDE - 3), height = 4 + rng() % (FUZZ_MAX_SIDE - 3);
+            // every fourth level is a generated one, as the game plays
+            std::string layout = made % 4 == 3 ? map(width, height, rng() | 1).serialise() : fuzzLevel(rng, width, height);
+            // runs of the same move push chains of boxes across the level
+            sequence.clear();
+            while (sequence.size() < 1000) {
+                sequence.insert(sequence.end(), 1 + rng() % 4, rng() % 4);
+            }
+            made++;
+            played += sequence.size();
+            if (fuzzCase(layout, sequence)) {
+                std::lock_guard<std::mutex> lock(foundLock);
+                if (!found) {
+                    found = true;
+                    failedLayout = layout;
+                    failedMoves = sequence;
+                }
+            }
+        }
+        levels += made;
+        moves += played;
+    });
+    double taken = std::max(std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count(), 1e-9);
+    std::cerr << levels << " levels, " << moves << " moves in " << taken << "s ("
+        << (size_t)(moves / taken) << " moves/s on " << workers.size() << " threads)" << std::endl;
+    if (!found) {
+        out << "No differences found." << std::endl;
+        return 0;
+    }
+
+    fuzzShrink(failedLayout, failedMoves);
+    fuzzDifference d;
+    fuzzCase(failedLayout, failedMoves, &d);
+    std::string keys;
+    for (uint8_t m : failedMoves) {
+        keys += replay::toKey(m);
+    }
+    if (d.step == -1) {
+        out << d.engine << " differs between rotations and reflections of:\n" << failedLayout
+            << "\n\nas it is:\n" << d.expected << "\n\nturned:\n" << d.got << std::endl;
+        return 1;
+    }
+    out << d.engine << " differs from map::move after move " << d.step + 1 << " of '" << keys << "' on:\n"
+        << failedLayout << "\n\nmap::move:\n" << d.expected << "\n\n" << d.engine << ":\n" << d.got << std::endl;
+    return 1;
+}
+
+// generates the levels for --endless on a background thread, keeping a few ready ahead of the player.
+// levels grow with every other level, and each is picked from a handful of candidates by how many pushes it needs.
+class levelStream {
+    private:
+        static constexpr int CANDIDATES = 4;
+        static constexpr int MAX_SIDE = 16;
+        static constexpr size_t NODE_LIMIT = 20000; // keeps each candidate's search well under a second
+        spsc<map*, 4> _ready; // the bound on levels generated but not yet played
+        // wakes the producer when a level is taken and the game when one is ready
+        std::mutex _lock;
+        std::condition_variable _wake;
+        std::atomic<bool> _stopping{false};
+        uint64_t _seed;
+        int _first; // the level the stream started from
+        int _taken = 0; // levels handed to the game so far
+        search::workspace _search; // reused by every candidate's check, only touched by the producer
+        std::thread _producer;
+
+        // the seed of the ith candidate for the nth level. past CANDIDATES these run into the next level's seeds,
+        // but that level is another size, so its candidates are other levels.
+        uint64_t _candidate(int n, int i) const {
+            return _seed + (uint64_t)n * CANDIDATES + i + 1;
+        }
+
+        // wakes whichever side is waiting on the other.
+        void _signal() {
+            {
+                std::lock_guard<std::mutex> lock(_lock);
+            }
+            _wake.notify_all();
+        }
+
+        // the nth level of the stream.
+        map _generate(int n) {
+            trace::span t("endless level");
+            int width = std::min(6 + (n+1)/2, MAX_SIDE);
+            int height = std::min(6 + n/2, MAX_SIDE);
+            int wantedPushes = 2 + n;
+            // the hardest solvable candidate wins, unless one reaches the wanted difficulty first. candidates that are
+            // proven impossible never win, more are drawn until one is solved or too big to check.
+            int best = -1, bestPushes = -1;
+            for (int i = 0; (i < CANDIDATES || best == -1) && !_stopping; i++) {
+                search::puzzle p(map(width, height, _candidate(n, i)).serialise());
+                // the exact push count matters less here than getting through corridors quickly
+                search::solver s(p, NODE_LIMIT, _search);
+                s.macros = true;
+                search::result r = s.bounded();
+                if (r.solved && r.pushes > bestPushes) {
+                    best = i;
+                    bestPushes = r.pushes;
+                } else if (!r.solved && r.exhausted && best == -1) {
+                    best = i; // too big to check, but not known to be impossible
+                }
+                if (bestPushes >= wantedPushes) {
+                    break;
+                }
+            }
+            // only left without a candidate when stopping, and then the level is thrown away
+            return map(width, height, _candidate(n, best == -1 ? 0 : best));
+        }
+
+        void _produce() {
+            trace::name("endless");
+            for (int n = _first; !_stopping; n++) {
+                map* m = new map(_generate(n));
+                bool queued = false;
+                {
+                    std::unique_lock<std::mutex> lock(_lock);
+                    _wake.wait(lock, [&]() { return _stopping || (queued = _ready.push(m)); });
+                }
+                if (!queued) {
+                    delete m;
+                    return;
+                }
+                _signal();
+            }
+        }
+
+    public:
+        // starts the stream at level first, so a saved run can carry on where it left off. candidates are checked in
+        // megabytes of search memory.
+        levelStream(uint64_t seed, int first, size_t megabytes) : _seed(seed), _first(first), _search(megabytes),
+                _producer(&levelStream::_produce, this) {}
+
+        uint64_t seed() const {
+            return _seed;
+        }
+
+        // the level that next() will return.
+        int position() const {
+            return _first + _taken;
+        }
+
+        ~levelStream() {
+            _stopping = true;
+            _signal();
+            _producer.join();
+            map* m;
+            while (_ready.pop(m)) {
+                delete m;
+            }
+        }
+
+        // takes the next level, only waiting if the player has caught up with the producer.
+        map next() {
+            map* m;
+            {
+                std::unique_lock<std::mutex> lock(_lock);
+                _wake.wait(lock, [&]() { return _ready.pop(m); });
+            }
+            _signal();
+            map out(std::move(*m));
+            delete m;
+            _taken++;
+            return out;
+        }
+};
+
+// finds the next push of a best solution for the player.
+// every position along a solution is remembered, so following a hint makes the next one immediate, and a
+// search that runs out of time is kept and carried on by the next request from the same position instead of
+// being started again. positions are compared after normalising the player, so walking around changes nothing.
+// a push off every remembered solution starts a new search from the new position: the old search tree is not
+// re-rooted, only its workspace and table memory are reused.
+class hinter {
+    private:
+        static const size_t NODE_LIMIT = 1 << 22;
+        struct push {
+            int cell, dir; // where the player stands and which way they push
+            int remaining; // pushes left to finish, this one included
+        };
+        search::workspace _w;
+        uint64_t _level = 0; // the levelHash of the level the remembered positions belong to
+        std::unordered_map<uint64_t, push> _known;
+        // the position being searched, kept between requests while its search is unfinished
+        std::unique_ptr<search::puzzle> _p;
+        std::unique_ptr<search::solver> _s;
+        uint64_t _searching = 0;
+        bool _unfinished = false;
+        search::walker _walk;
+
+        // the hash of the position in p, with the player normalised to the lowest cell they can reach.
+        uint64_t _key(const search::puzzle& p, const uint64_t * bits, int player) {
+            return p.hash(bits, _walk.flood(p, bits, player));
+        }
+
+        // replays path from the start of p and returns its pushes, each with the position before it.
+        std::vector<std::pair<std::vector<uint64_t>, push>> _pushes(const search::puzzle& p, const std::vector<uint8_t>& path) {
+            std::vector<std::pair<std::vector<uint64_t>, push>> out;
+            std::vector<uint64_t> bits(p.start);
+            int player = p.player;
+            for (uint8_t d : path) {
+                std::vector<uint64_t> before(bits);
+                int pushed;
+                int moved = search::step(p, bits.data(), player, d, pushed);
+                if (pushed > 0) {
+                    out.push_back({std::move(before), {player, d, 0}});
+                }
+                player = moved;
+            }
+            for (size_t i = 0; i < out.size(); i++) {
+                out[i].second.remaining = out.size() - i;
+            }
+            return out;
+        }
+
+    public:
+        // searches in megabytes of memory, which is kept between hints.
+        explicit hinter(size_t megabytes) : _w(megabytes) {}
+
+        struct hint {
+            bool found = false; // false if no push was found in time
+            bool exact = false; // true if the push is on a plan that finishes the level, false for a best guess so far
+            bool stuck = false; // the level cannot be finished from here
+            int x = 0, y = 0; // where to stand
+            int dir = 0; // which way to push
+            int remaining = 0; // pushes left on the plan found if exact, the fewest possible may be lower
+        };
+
+        // the next best push in m, searching for at most budget. asking again from the same position carries on.
+        hint next(const map& m, std::chrono::milliseconds budget) {
+            trace::span t("hint");
+            auto deadline = std::chrono::steady_clock::now() + budget;
+            if (m.levelHash != _level) {
+                _known.clear();
+                _level = m.levelHash;
+                _unfinished = false;
+            }
+            hint h;
+            search::puzzle here(m.serialise());
+            uint64_t key = _key(here, here.start.data(), here.player);
+            auto toHint = [&](const push& p, bool exact) {
+                h.found = true;
+                h.exact = exact;
+                h.x = p.cell % here.width;
+                h.y = p.cell / here.width + 1;
+                h.dir = p.dir;
+                h.remaining = p.remaining;
+            };
+            auto known = _known.find(key);
+            if (known != _known.end()) {
+                toHint(known->second, true);
+                return h;
+            }
+
+            search::result r;
+            if (_unfinished && key == _searching) {
+                r = _s->resume(deadline);
+            } else {
+                _s.reset();
+                _p.reset(new search::puzzle(here));
+                _s.reset(new search::solver(*_p, NODE_LIMIT, _w));
+                // tunnels and goal rooms are taken in one step, which finds hints far sooner on corridor levels
+                _s->macros = true;
+                _searching = key;
+                r = _s->bounded(deadline);
+            }
+            if (!r.solved && !r.timedOut && !r.exhausted && _s->macros) {
+                // the macros can miss a solution, so only a search without them may call the level lost
+                _s->macros = false;
+                r = _s->bounded(deadline);
+            }
+            _unfinished = r.timedOut;
+            if (r.solved) {
+                // remember every position along the solution
+                for (const auto& p : _pushes(*_p, r.path)) {
+                    _known[_key(*_p, p.first.data(), p.second.cell)] = p.second;
+                }
+                toHint(_known[key], true);
+            } else if (!r.timedOut && !r.exhausted) {
+                h.stuck = true;
+            } else {
+                auto guess = _pushes(*_p, _s->closest());
+                if (!guess.empty()) {
+                    toHint(guess[0].second, false);
+                }
+            }
+            return h;
+        }
+};
+
+// contains all of the game data.
+struct boxpush {
+    static constexpr size_t UNDO_DEPTH = 100;
+    std::vector<map> maps;
+    int mapIndex = 0;
+    // in endless mode levels come from here, and maps only ever holds the one being played
+    levelStream* stream = nullptr;
+    // positions of the current map that u goes back to, the latest last
+    std::deque<checkpoint> undo;
+
+    // returns a reference to the map at the current map index.
+    map& currentMap() {
+        return stream != nullptr ? maps[0] : maps[mapIndex];
+    }
+
+    // keeps before, the current map's position ahead of an action, for u to go back to. positions are only kept
+    // if the action played or reset anything, and only the last UNDO_DEPTH of them.
+    void remember(checkpoint before) {
+        if (before.journal.size() == currentMap().journal.size()) {
+            return;
+        }
+        undo.push_back(std::move(before));
+        if (undo.size() > UNDO_DEPTH) {
+            undo.pop_front();
+        }
+    }
+
+    // takes back the last action that changed the current map. returns false if there is none.
+    bool takeBack() {
+        if (undo.empty()) {
+            return false;
+        }
+        currentMap().restore(undo.back());
+        undo.pop_back();
+        return true;
+    }
+
+    // moves on to the next level. returns false if there are none left.
+    bool advance() {
+        undo.clear();
+        if (stream != nullptr) {
+            // the finished level is freed before the next is taken
+            maps.clear();
+            maps.push_back(stream->next());
+        } else if (mapIndex == maps.size()-1) {
+            return false;
+        }
+        mapIndex++;
+        return true;
+    }
+
+    boxpush(std::vector<map> ms) : maps(std::move(ms)) {}
+};
+
+// the start of a save file, followed by a savedMap for every map and then their arrays.
+struct saveHeader {
+    char magic[8]; // "BXSAVE2"
+    uint32_t objectSize; // OBJECT_BYTES
+    uint32_t mapCount;
+    int32_t mapIndex;
+    int32_t endless; // 1 if the session was an endless run
+    uint64_t endlessSeed;
+    int64_t endlessPosition; // the next level of the endless run
+};
+
+// a saveHeader is saved as its fields in order: the magic, two u32, two i32 then two 64 bit values.
+const size_t SAVE_HEADER_BYTES = 8 + 4*4 + 2*8;
+
+void writeSaveHeader(std::vector<uint8_t>& out, const saveHeader& h) {
+    out.insert(out.end(), h.magic, h.magic + 8);
+    for (uint32_t v : { h.objectSize, h.mapCount, (uint32_t)h.mapIndex, (uint32_t)h.endless }) {
+        writeBytes(out, v, 4);
+    }
+    writeBytes(out, h.endlessSeed, 8);
+    writeBytes(out, (uint64_t)h.endlessPosition, 8);
+}
+
+// reads a header written by writeSaveHeader().
+saveHeader readSaveHeader(const uint8_t* in) {
+    saveHeader h;
+    std::memcpy(h.magic, in, 8);
+    h.objectSize = readBytes(in + 8, 4);
+    h.mapCount = readBytes(in + 12, 4);
+    h.mapIndex = (int32_t)readBytes(in + 16, 4);
+    h.endless = (int32_t)readBytes(in + 20, 4);
+    h.endlessSeed = readBytes(in + 24, 8);
+    h.endlessPosition = (int64_t)readBytes(in + 32, 8);
+    return h;
+}
+
+// writes the whole session to path: every level as it is now and as it started, scores and journals.
+// the file is written beside path and renamed over it, so a crash never leaves half a save.
+bool saveSession(const boxpush& game, const std::string& path) {
+    trace::span t("save");
+    std::vector<uint8_t> file(SAVE_HEADER_BYTES + game.maps.size() * SAVED_MAP_BYTES);
+    std::vector<savedMap> records;
+    for (const auto& m : game.maps) {
+        records.push_back(m.saveTo(file));
+    }
+    saveHeader h = {};
+    std::memcpy(h.magic, "BXSAVE2", 8);
+    h.objectSize = OBJECT_BYTES;
+    h.mapCount = game.maps.size();
+    h.mapIndex = game.mapIndex;
+    h.endless = game.stream != nullptr;
+    h.endlessSeed = game.stream != nullptr ? game.stream->seed() : 0;
+    h.endlessPosition = game.stream != nullptr ? game.stream->position() : 0;
+    std::vector<uint8_t> front;
+    writeSaveHeader(front, h);
+    for (const savedMap& s : records) {
+        writeSavedMap(front, s);
+    }
+    std::copy(front.begin(), front.end(), file.begin());
+
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        out.write((const char*)file.data(), file.size());
+        if (!out.good()) {
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temporary, path, ec);
+    return !ec;
+}
+
+// a read-only view of a whole file, mapped into memory where the platform allows it.
+class mappedFile {
+    private:
+        const uint8_t* _data = nullptr;
+        size_t _size = 0;
+#ifdef _WIN32
+        std::vector<uint8_t> _buffer;
+#endif
+
+    public:
+        explicit mappedFile(const std::string& path) {
+#ifndef _WIN32
+            int fd = open(path.c_str(), O_RDONLY);
+            struct stat st;
+            if (fd == -1) {
+                return;
+            }
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                void* m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (m != MAP_FAILED) {
+                    _data = (const uint8_t*)m;
+                    _size = st.st_size;
+                }
+            }
+            close(fd);
+#else
+            std::ifstream in(path, std::ios::binary);
+            _buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            _data = _buffer.data();
+            _size = _buffer.size();
+#endif
+        }
+
+        ~mappedFile() {
+#ifndef _WIN32
+            if (_data != nullptr) {
+                munmap((void*)_data, _size);
+            }
+#endif
+        }
+
+        mappedFile(const mappedFile&) = delete;
+        mappedFile& operator=(const mappedFile&) = delete;
+
+        const uint8_t* data() const {
+            return _data;
+        }
+        size_t size() const {
+            return _size;
+        }
+};
+
+// loads a session written by saveSession() into maps and h. returns false if path is missing or is not a usable save.
+bool loadSession(const std::string& path, std::vector<map>& maps, saveHeader& h) {
+    trace::span t("load");
+    mappedFile file(path);
+    if (file.size() < SAVE_HEADER_BYTES) {
+        return false;
+    }
+    h = readSaveHeader(file.data());
+    if (std::memcmp(h.magic, "BXSAVE2", 8) != 0 || h.objectSize != OBJECT_BYTES || h.mapCount == 0
+            || h.mapCount > (file.size() - SAVE_HEADER_BYTES) / SAVED_MAP_BYTES || h.mapIndex < 0
+            || (h.endless != 0 && h.endless != 1) || (!h.endless && (uint32_t)h.mapIndex >= h.mapCount)) {
+        return false;
+    }
+    std::vector<savedMap> records;
+    for (uint32_t i = 0; i < h.mapCount; i++) {
+        records.push_back(readSavedMap(file.data() + SAVE_HEADER_BYTES + i*SAVED_MAP_BYTES));
+        if (!map::validSave(records.back(), file.data(), file.size())) {
+            return false;
+        }
+    }
+    maps.clear();
+    maps.reserve(h.mapCount);
+    for (uint32_t i = 0; i < h.mapCount; i++) {
+        maps.emplace_back(records[i], file.data());
+    }
+    return true;
+}
+
+// a single command from the player.
+struct action {
+    char key = 0; // '\0' once the input has closed
+    int count = 1; // how many times a movement key repeats
+    int x = 0, y = 0; // the cell for 'g'
+    bool valid = true; // false if the cell for 'g' could not be read
+};
+
+// the time between frames, and how often spectators are served while nothing else happens.
+const auto FRAME_TIME = std::chrono::microseconds(1000000 / 60);
+const auto SPECTATOR_POLL = std::chrono::milliseconds(50);
+// how long a hint may search for before giving its best guess, pressing h again carries on
+const auto HINT_BUDGET = std::chrono::milliseconds(50);
+
+// wakes the game loop when input arrives, so it can sleep for as long as nothing happens.
+struct doorbell {
+    std::mutex lock;
+    std::condition_variable rung;
+    bool pending = false;
+
+    void ring() {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            pending = true;
+        }
+        rung.notify_one();
+    }
+
+    // waits until the bell rings, or until deadline if there is one.
+    void wait(const std::chrono::steady_clock::time_point* deadline = nullptr) {
+        std::unique_lock<std::mutex> l(lock);
+        if (deadline != nullptr) {
+            rung.wait_until(l, *deadline, [&]() { return pending; });
+        } else {
+            rung.wait(l, [&]() { return pending; });
+        }
+        pending = false;
+    }
+};
+
+// reads the player's commands from the console into actions until the input closes, ringing bell for each.
+// the thread shares ownership of both, as it may still be blocked on the console after the game has returned.
+void readActions(std::shared_ptr<spsc<action, 1024>> actions, std::shared_ptr<doorbell> bell) {
+    trace::name("input");
+    while (true) {
+        action a;
+        if (std::cin >> a.key) {
+            if (a.key == 'g') {
+                // the cell to walk to, x,y straight after the g or after a space
+                char comma;
+                if (!(std::cin >> a.x >> comma >> a.y)) {
+                    a.valid = false;
+                    std::cin.clear();
+                }
+            } else if (std::isdigit(std::cin.peek())) {
+                // a number after any other key repeats it, e.g. d20
+                std::cin >> a.count;
+            }
+        } else {
+            a.key = '\0';
+        }
+        // the game drains the queue every frame, so it is only ever full for a moment
+        while (!actions->push(a)) {
+            std::this_thread::yield();
+        }
+        bell->ring();
+        if (a.key == '\0') {
+            return;
+        }
+    }
+}
+
+// follows a game started with --spectate on the socket at path, drawing each frame as it arrives.
+int watchGame(const std::string& path) {
+    spectate::watcher w;
+    if (!w.open(path)) {
+        return fatal("There is no game to watch at '" + path + "'.");
+    }
+    spectate::view v;
+    while (w.next(v)) {
+        if (!map::validLayout(v.layout)) {
+            continue;
+        }
+        map m(v.layout);
+        std::cout << clearConsole(m.height);
+        std::cout << pty::paint("> Watching | Score : ", {"grey", "bold"}) << pty::paint(m.score, m.score == 0 ? "red" : "green");
+        std::cout << pty::paint(" | Level : ", {"grey", "bold"}) << pty::paint(std::to_string(v.level), "orange") << "\n";
+        std::cout << m.draw() << std::flush;
+    }
+    std::cout << pty::paint("\nThe game has ended.", "grey") << std::endl;
+    return 0;
+}
+
+int main(int argc, char ** argv) {
+    // check if any game modifiers have been passed
+    argh::parser parser;
+    parser.add_params({
+        "--map", // <width,height>
+        "--override-player", // <text>
+        "--override-box", // <text>
+        "--override-target", // <text>
+        "--override-border", // <text>
+        "--override-background", // <text>
+        "--override-tick", // <text>
+        "--trace", // <file>
+        "--generate", // <count>
+        "--dedup", // <pack>
+        "--record", // <dir>
+        "--verify-replays", // <dir>
+        "--analyse", // <pack>
+        "--node-limit", // <count>
+        "--save", // <file>
+        "--tt-mb", // <megabytes>
+        "--spectate", // <socket>
+        "--watch", // <socket>
+        "--fuzz", // <seconds>
+    });
+
+    // if these have a value above -1, then --map has been passed
+    int optionalWidth = -1;
+    int optionalHeight = -1;
+
+    // pack tools, the game is not started if either is used
+    int generateCount = 0;
+    std::string dedupPath;
+    std::string verifyPath;
+    std::string analysePath;
+    double fuzzSeconds = 0;
+    size_t nodeLimit = DEFAULT_NODE_LIMIT;
+    size_t searchMegabytes = DEFAULT_SEARCH_MB;
+    // where replays of solved levels are written, if anywhere
+    std::string recordPath;
+    // where the session is saved on quitting, and resumed from
+    std::string savePath = "boxpush.save";
+    // the socket spectators connect to, and the one to watch instead of playing
+    std::string spectatePath;
+    std::string watchPath;
+
+    // parse arguments
+    parser.parse(argv);
+    for (const auto& argCouple : parser.params()) {
+        if (argCouple.first == "map") {
             // parse width and height from the provided text
             std::string widthS, heightS;
             int switchIndex = argCouple.second.find(',');
@@ -389,6 +2437,51 @@ int main(int argc, char ** argv) {
             } catch (std::exception) {
                 return fatal("Error parsing width and height from '--map' parameter.");
             }
+        } else if (argCouple.first == "generate") {
+            generateCount = std::atoi(argCouple.second.c_str());
+            if (generateCount < 1) {
+                return fatal("'--generate' needs a number of levels above 0.");
+            }
+        } else if (argCouple.first == "dedup") {
+            dedupPath = argCouple.second;
+        } else if (argCouple.first == "analyse") {
+            analysePath = argCouple.second;
+        } else if (argCouple.first == "fuzz") {
+            fuzzSeconds = std::atof(argCouple.second.c_str());
+            if (fuzzSeconds <= 0) {
+                return fatal("'--fuzz' needs a number of seconds above 0.");
+            }
+        } else if (argCouple.first == "node-limit") {
+            long long limit = std::atoll(argCouple.second.c_str());
+            if (limit < 1) {
+                return fatal("'--node-limit' needs a number above 0.");
+            }
+            nodeLimit = limit;
+        } else if (argCouple.first == "tt-mb") {
+            long long megabytes = std::atoll(argCouple.second.c_str());
+            if (megabytes < 1) {
+                return fatal("'--tt-mb' needs a number of megabytes above 0.");
+            }
+            searchMegabytes = megabytes;
+        } else if (argCouple.first == "verify-replays") {
+            verifyPath = argCouple.second;
+        } else if (argCouple.first == "save") {
+            savePath = argCouple.second;
+        } else if (argCouple.first == "record") {
+            recordPath = argCouple.second;
+        } else if (argCouple.first == "spectate" || argCouple.first == "watch") {
+            if (!spectate::SUPPORTED) {
+                return fatal("Spectating is not supported on Windows.");
+            }
+            (argCouple.first == "spectate" ? spectatePath : watchPath) = argCouple.second;
+        } else if (argCouple.first == "trace") {
+            // record chrome trace-events until the game exits
+            trace::start(argCouple.second);
+            std::atexit([]() {
+                if (!trace::finish()) {
+                    std::cerr << pty::paint("Could not write the trace to '" + trace::path + "'.", "lightred") << std::endl;
+                }
+            });
         } else {
             // if the function is an override function, parse override type
             std::string overrideType;
@@ -414,65 +2507,198 @@ int main(int argc, char ** argv) {
         }
     }
 
+    alignDrawings();
+
+    // run the pack tools instead of the game
+    if (generateCount > 0) {
+        generatePack(std::cout, generateCount, optionalWidth > -1 ? optionalWidth : 10, optionalHeight > -1 ? optionalHeight : 10);
+        return 0;
+    } else if (!dedupPath.empty()) {
+        return dedupPack(dedupPath, std::cout);
+    } else if (!verifyPath.empty()) {
+        return verifyReplays(verifyPath, std::cout);
+    } else if (!analysePath.empty()) {
+        return analysePack(analysePath, std::cout, nodeLimit, searchMegabytes);
+    } else if (fuzzSeconds > 0) {
+        return fuzzEngines(std::cout, fuzzSeconds);
+    } else if (parser["bench-tt"]) {
+        return benchTable(std::cout, searchMegabytes);
+    } else if (!watchPath.empty()) {
+        return watchGame(watchPath);
+    }
+
+    auto actions = std::make_shared<spsc<action, 1024>>();
+    auto bell = std::make_shared<doorbell>();
+
+    // --resume?
+    std::vector<map> resumed;
+    saveHeader saved = {};
+    if (parser["resume"] && !loadSession(savePath, resumed, saved)) {
+        return fatal("There is no saved game to resume at '" + savePath + "'.");
+    }
+
+    // --endless?
+    std::unique_ptr<levelStream> stream;
+    if (!resumed.empty() ? saved.endless : parser["endless"]) {
+        stream = !resumed.empty()
+            ? std::make_unique<levelStream>(saved.endlessSeed, saved.endlessPosition, std::max<size_t>(1, searchMegabytes / ENDLESS_SHARE))
+            : std::make_unique<levelStream>(randomSeed(), 0, std::max<size_t>(1, searchMegabytes / ENDLESS_SHARE));
+    }
+
     // initialise the main game object and the maps.
     boxpush game(
+        !resumed.empty()
+        ? std::move(resumed)
+        : stream
+        ? std::vector<map>{ stream->next() }
         // --map?
-        optionalWidth > -1
-        ? std::initializer_list<map>{ map(optionalWidth, optionalHeight) }
-        : std::initializer_list<map>{
+        : optionalWidth > -1
+        ? std::vector<map>{ map(optionalWidth, optionalHeight) }
+        : std::vector<map>{
             map(10, 10), map(12, 8), map(10, 8),
             map(10, 12), map(12, 12), map(8, 8),
             map(10, 10), map(12, 9), map(11, 11),
             map(11, 12)
         }
     );
+    game.stream = stream.get();
+    game.mapIndex = saved.mapIndex;
+
+    // --spectate?
+    std::unique_ptr<spectate::broadcaster> spectators;
+    if (!spectatePath.empty()) {
+        spectators = std::make_unique<spectate::broadcaster>();
+        if (!spectators->open(spectatePath)) {
+            return fatal("Could not open a socket for spectators at '" + spectatePath + "'.");
+        }
+    }
+
+    // input is read on its own thread, so drawing never holds it up
+    std::thread(readActions, actions, bell).detach();
 
     // start game mainloop
+    std::string status; // shown under the next frame
+    std::unique_ptr<hinter> hints;
+    bool dirty = true; // has anything changed since the last frame?
+    bool closed = false; // has the input closed?
+    auto nextFrame = std::chrono::steady_clock::now();
     while (true) {
+        // apply every action that has arrived since the last pass
+        action a;
+        while (actions->pop(a)) {
+            // get current map
+            map& cm = game.currentMap();
+
+            // get the player object
+            object& player = cm.objects[cm.player];
+
+            // move the player
+            int mX, mY;
+            if (a.key == '\0') {
+                closed = true; // input closed, draw the last frame and stop
+                break;
+            } else if (keyToDirection(a.key, mX, mY)) {
+                checkpoint before = cm.save();
+                cm.moveRun(&player, mX, mY, a.count);
+                game.remember(std::move(before));
+            } else if (a.key == 'r') {
+                checkpoint before = cm.save();
+                cm.reset(); // reset the map
+                game.remember(std::move(before));
+            } else if (a.key == 'u') {
+                // go back to before the last move, walk or reset
+                if (!game.takeBack()) {
+                    status = pty::paint("There is nothing to take back on this level.", "orange");
+                }
+            } else if (a.key == 'q') {
+                // save everything so --resume can pick up from here
+                if (!saveSession(game, savePath)) {
+                    return fatal("Could not save the game to '" + savePath + "'.");
+                }
+                std::cout << pty::paint("\nSaved, use --resume to carry on.", "green") << std::endl;
+                return 0;
+            } else if (a.key == 'h') {
+                // built on first use, its search memory is not worth holding for players who never ask
+                if (!hints) {
+                    hints.reset(new hinter(std::max<size_t>(1, searchMegabytes / HINT_SHARE)));
+                }
+                hinter::hint h = hints->next(cm, HINT_BUDGET);
+                static const char * DIRECTIONS[] = {"up", "left", "down", "right"};
+                if (h.stuck) {
+                    status = pty::paint("There is no way to finish the level from here, press r to start it again.", "lightred");
+                } else if (!h.found) {
+                    status = pty::paint("No hint yet, press h again to keep looking.", "orange");
+                } else {
+                    std::string where = std::to_string(h.x) + "," + std::to_string(h.y);
+                    status = pty::paint("Hint: from " + where + " push " + DIRECTIONS[h.dir], "green")
+                        + pty::paint(h.exact
+                            ? " (done in at most " + std::to_string(h.remaining) + (h.remaining == 1 ? " push" : " pushes") + ", g " + where + " walks there)."
+                            : " (a best guess so far, press h again to keep looking).", "grey");
+                }
+            } else if (a.key == 'g') {
+                // walk to the cell given as x,y
+                checkpoint before = cm.save();
+                if (!a.valid || !cm.goTo(a.x, a.y)) {
+                    status = pty::paint("You cannot walk there without pushing something.", "lightred");
+                }
+                game.remember(std::move(before));
+            } else {
+                continue;
+            }
+            dirty = true;
+
+            // if the player has won, go to next level!
+            if (cm.score == cm.totalScore) {
+                if (!recordPath.empty() && !recordReplay(cm, recordPath)) {
+                    std::cerr << pty::paint("Could not write a replay to '" + recordPath + "'.", "lightred") << std::endl;
+                }
+                if (!game.advance()) {
+                    return 0;
+                }
+            }
+        }
+
+        // draw at most one frame per refresh, and only if something changed
+        auto now = std::chrono::steady_clock::now();
+        if (closed && !dirty) {
+            return 0;
+        } else if (!closed && (!dirty || now < nextFrame)) {
+            // sleep until the next frame is due or input arrives, waking now and then for spectators
+            auto wake = now + SPECTATOR_POLL;
+            if (spectators) {
+                spectators->poll(); // take on new spectators and keep slow ones fed while idle
+                wake = dirty ? std::min(wake, nextFrame) : wake;
+                bell->wait(&wake);
+            } else {
+                bell->wait(dirty ? &nextFrame : nullptr);
+            }
+            continue;
+        }
+        nextFrame = now + FRAME_TIME;
+        dirty = false;
+
         // get current map
         map& cm = game.currentMap();
+        const object& player = cm.objects[cm.player];
 
-        // get the player object
-        object& player = cm.objects[cm.player];
+        // spectators draw for themselves, they are only sent what changed
+        if (spectators) {
+            trace::span t("spectate");
+            spectators->publish(cm.width, cm.height, game.mapIndex + 1, cm.serialise());
+        }
 
         // draw to terminal
         const std::string drn = cm.draw();
-        std::cout << clearConsole(cm.height);
-        std::cout << pty::paint("> Score : ", {"grey", "bold"}) << pty::paint(cm.score, cm.score == 0 ? "red" : "green");
-        std::cout << pty::paint(" | Level : ", {"grey", "bold"}) << pty::paint(std::to_string(game.mapIndex + 1) + " / " + std::to_string(game.maps.size()), "orange");
-        std::cout << pty::paint(" | Player co-ordinates : ", {"grey", "bold"}) << player.x << " , " << player.y << std::endl;
-        std::cout << drn;
-
-        // await user input
-        retake: // for retaking key input
-        std::cout << pty::paint("\nWhich way do you wish to move?", "bold") << pty::paint(" (" + CONTROLS_GRID + ")", "grey") << ": ";
-        char moveKey;
-        std::cin >> moveKey;
-
-        // move the player
-        switch (moveKey) {
-            case 'w':
-            cm.move(&player, 0, 1); break;
-            case 'a':
-            cm.move(&player, -1, 0); break;
-            case 's':
-            cm.move(&player, 0, -1); break;
-            case 'd':
-            cm.move(&player, 1, 0); break;
-            case 'r':
-            cm.reset(); break; // reset the map
-            default:
-            goto retake;
-        }
-
-        // if the player has won, go to next level!
-        if (cm.score == cm.totalScore) {
-            if (game.mapIndex == game.maps.size()-1) {
-                return 0;
-            } else {
-                game.mapIndex++;
-            }
+        {
+            trace::span t("flush");
+            std::cout << clearConsole(cm.height);
+            std::cout << pty::paint("> Score : ", {"grey", "bold"}) << pty::paint(cm.score, cm.score == 0 ? "red" : "green");
+            std::cout << pty::paint(" | Level : ", {"grey", "bold"}) << pty::paint(std::to_string(game.mapIndex + 1) + (stream ? "" : " / " + std::to_string(game.maps.size())), "orange");
+            std::cout << pty::paint(" | Player co-ordinates : ", {"grey", "bold"}) << player.x << " , " << player.y << "\n";
+            std::cout << drn << status;
+            std::cout << pty::paint("\nWhich way do you wish to move?", "bold") << pty::paint(" (" + CONTROLS_GRID + ")", "grey") << ": " << std::flush;
         }
+        status.clear();
     }
 
     return 0;
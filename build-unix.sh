@@ -1 +1 @@
-g++ boxpush.cpp -o build/unix
\ No newline at end of file
+g++ boxpush.cpp -pthread -o build/unix
\ No newline at end of file
@@ -0,0 +1,127 @@
+// a bump allocator: memory is handed out from large blocks and only given back all at once.
+// meant for things that live and die together, such as the nodes of one search, so that building and
+// throwing them away costs a few calls to malloc rather than one per object.
+// an arena is not thread safe, give every thread its own.
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+class arena {
+    private:
+        struct block {
+            block* next;
+            size_t size; // usable bytes after the header
+        };
+        static const size_t HEADER = (sizeof(block) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+        block* _blocks = nullptr; // the newest block first
+        char* _at = nullptr; // the next free byte of the newest block
+        char* _end = nullptr;
+        size_t _blockSize;
+        size_t _used = 0;
+
+        static char* _data(block* b) {
+            return reinterpret_cast<char*>(b) + HEADER;
+        }
+
+        // starts a new block of at least bytes.
+        void _grow(size_t bytes) {
+            size_t size = std::max(bytes, _blockSize);
+            block* b = static_cast<block*>(::operator new(HEADER + size));
+            b->next = _blocks;
+            b->size = size;
+            _blocks = b;
+            _at = _data(b);
+            _end = _at + size;
+        }
+
+        void _free(block* b) {
+            while (b != nullptr) {
+                block* next = b->next;
+                ::operator delete(b);
+                b = next;
+            }
+        }
+
+    public:
+        // blockSize is how much is asked of the system at a time, allocations larger than it get a block of their own.
+        explicit arena(size_t blockSize = 1 << 20) : _blockSize(blockSize) {}
+
+        ~arena() {
+            _free(_blocks);
+        }
+
+        arena(const arena&) = delete;
+        arena& operator=(const arena&) = delete;
+
+        // returns bytes of uninitialised memory aligned to align, a power of two no larger than a cache line.
+        void* allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+            uintptr_t at = ((uintptr_t)_at + align - 1) & ~(uintptr_t)(align - 1);
+            if (_at == nullptr || at + bytes > (uintptr_t)_end) {
+                _grow(bytes + align);
+                at = ((uintptr_t)_at + align - 1) & ~(uintptr_t)(align - 1);
+            }
+            _used += at + bytes - (uintptr_t)_at;
+            _at = reinterpret_cast<char*>(at + bytes);
+            return reinterpret_cast<void*>(at);
+        }
+
+        // returns room for n objects of T. they are not constructed, so T must not need to be.
+        template<typename T>
+        T* make(size_t n) {
+            static_assert(std::is_trivially_destructible<T>::value, "arenas never run destructors");
+            return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+        }
+
+        // frees everything allocated so far in one go. the largest block is kept for reuse, so an arena
+        // that is reset between jobs of a similar size stops asking the system for memory after the first.
+        void reset() {
+            if (_blocks == nullptr) {
+                return;
+            }
+            block* keep = _blocks;
+            for (block* b = _blocks; b != nullptr; b = b->next) {
+                if (b->size > keep->size) {
+                    keep = b;
+                }
+            }
+            // unlink the kept block and free the rest
+            block* rest = nullptr;
+            for (block* b = _blocks; b != nullptr; ) {
+                block* next = b->next;
+                if (b != keep) {
+                    b->next = rest;
+                    rest = b;
+                }
+                b = next;
+            }
+            _free(rest);
+            keep->next = nullptr;
+            _blocks = keep;
+            _at = _data(keep);
+            _end = _at + keep->size;
+            _used = 0;
+        }
+
+        // the bytes handed out since the last reset, including alignment padding.
+        size_t used() const {
+            return _used;
+        }
+
+        // the bytes held from the system.
+        size_t reserved() const {
+            size_t total = 0;
+            for (block* b = _blocks; b != nullptr; b = b->next) {
+                total += b->size;
+            }
+            return total;
+        }
+};
+
+#endif
@@ -0,0 +1,227 @@
+// fixed-size boards for headless play: the rules of map::move for a W x H level, with the size known at compile time.
+// the level is three bitsets in a std::array of a word or three, so a board lives in registers and on the stack,
+// neighbours are constant offsets and every loop has a constant trip count the compiler can unroll.
+// cells are numbered as in map, (y-1)*W + x with y = 1 at the bottom, and directions as in replays.
+//
+// withBoard() picks the board for a level's size at runtime. only the sizes in [MIN_SIDE, MAX_SIDE] are compiled,
+// which cover the default levels, anything else is left to the generic map.
+
+#ifndef BOARD_HPP
+#define BOARD_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "layout.hpp"
+
+template<int W, int H>
+class board {
+    public:
+        static constexpr int WIDTH = W, HEIGHT = H, CELLS = W * H;
+        static constexpr int WORDS = (CELLS + 63) / 64;
+        using bits = std::array<uint64_t, WORDS>;
+
+    private:
+        bits _boxes{}; // boxes that can still move
+        bits _captured{}; // boxes on targets, which block everything
+        bits _targets{}; // targets that have not been captured
+        int _player = 0;
+        int _score = 0, _totalScore = 0;
+
+        static bool _test(const bits& b, int c) {
+            return (b[c >> 6] >> (c & 63)) & 1;
+        }
+        static void _set(bits& b, int c) {
+            b[c >> 6] |= 1ULL << (c & 63);
+        }
+        static void _clear(bits& b, int c) {
+            b[c >> 6] &= ~(1ULL << (c & 63));
+        }
+
+        // the cell next to c in direction D, or -1 off the board. D and the bounds are constants, so this is a
+        // compare and an add.
+        template<int D>
+        static int _next(int c) {
+            static_assert(D >= 0 && D < 4, "directions are 0 to 3");
+            if (D == 0) {
+                return c < CELLS - W ? c + W : -1;
+            } else if (D == 1) {
+                return c % W != 0 ? c - 1 : -1;
+            } else if (D == 2) {
+                return c >= W ? c - W : -1;
+            } else {
+                return c % W != W - 1 ? c + 1 : -1;
+            }
+        }
+
+        template<int D>
+        bool _move() {
+            // walk to the end of the chain in front of the player, no chain is longer than the board is wide or tall
+            int first = -1;
+            int n = _next<D>(_player);
+            constexpr int LONGEST = (D == 0 || D == 2) ? H : W;
+            #pragma GCC unroll 16
+            for (int i = 0; i < LONGEST; i++) {
+                if (n == -1 || _test(_captured, n)) {
+                    return false;
+                }
+                if (!_test(_boxes, n)) {
+                    break;
+                }
+                first = first == -1 ? n : first;
+                n = _next<D>(n);
+            }
+            // a chain moving one cell is the same as its first box jumping to the far end
+            if (first != -1) {
+                _clear(_boxes, first);
+                if (_test(_targets, n)) {
+                    _clear(_targets, n);
+                    _set(_captured, n);
+                    _score++;
+                } else {
+                    _set(_boxes, n);
+                }
+            }
+            _player = _next<D>(_player);
+            return true;
+        }
+
+    public:
+        // loads a level from the text written by map::serialise(), which must be W x H and pass map::validLayout().
+        explicit board(const std::string& layout) {
+            int x = 0, r = 0;
+            for (char ch : layout) {
+                if (ch == '\n') {
+                    x = 0;
+                    r++;
+                    continue;
+                }
+                int c = (H - 1 - r) * W + x;
+                if (ch == '@' || ch == '+') {
+                    _player = c;
+                }
+                if (ch == '.' || ch == '+') {
+                    _set(_targets, c);
+                }
+                if (ch == '$') {
+                    _set(_boxes, c);
+                }
+                if (ch == '*') {
+                    _set(_captured, c);
+                    _score++;
+                }
+                _totalScore += ch == '.' || ch == '+' || ch == '*';
+                x++;
+            }
+        }
+
+        // moves the player in direction d as map::move does. returns false if nothing could move.
+        bool move(int d) {
+            switch (d & 3) {
+                case 0: return _move<0>();
+                case 1: return _move<1>();
+                case 2: return _move<2>();
+                default: return _move<3>();
+            }
+        }
+
+        // plays count moves, stopping once the level is solved. returns how many were played.
+        size_t play(const uint8_t * moves, size_t count) {
+            size_t i = 0;
+            for (; i < count && !solved(); i++) {
+                move(moves[i]);
+            }
+            return i;
+        }
+
+        bool solved() const {
+            return _score == _totalScore;
+        }
+
+        int score() const {
+            return _score;
+        }
+
+        int totalScore() const {
+            return _totalScore;
+        }
+
+        int player() const {
+            return _player;
+        }
+
+        const bits& boxes() const {
+            return _boxes;
+        }
+
+        const bits& captured() const {
+            return _captured;
+        }
+
+        const bits& targets() const {
+            return _targets;
+        }
+
+        // writes the level as map::serialise() does into out, which must have room for (W+1)*H - 1 characters.
+        void render(char * out) const {
+            #pragma GCC unroll 16
+            for (int r = 0; r < H; r++) {
+                const int row = (H - 1 - r) * W;
+                #pragma GCC unroll 16
+                for (int x = 0; x < W; x++) {
+                    const int c = row + x;
+                    const bool target = _test(_targets, c);
+                    *out++ = c == _player ? (target ? '+' : '@')
+                        : _test(_captured, c) ? '*'
+                        : _test(_boxes, c) ? '$'
+                        : target ? '.' : '-';
+                }
+                if (r < H - 1) {
+                    *out++ = '\n';
+                }
+            }
+        }
+
+        std::string serialise() const {
+            std::string text((W + 1) * H - 1, '-');
+            render(&text[0]);
+            return text;
+        }
+};
+
+namespace boards {
+
+    const int MIN_SIDE = 8, MAX_SIDE = 12;
+
+    // true if a board of width x height is compiled in.
+    inline bool fits(int width, int height) {
+        return width >= MIN_SIDE && width <= MAX_SIDE && height >= MIN_SIDE && height <= MAX_SIDE;
+    }
+
+    template<int H, typename F, int... W>
+    bool _row(int w, int h, const std::string& layout, F& f, std::integer_sequence<int, W...>) {
+        return ((w == MIN_SIDE + W && h == H && (f(board<MIN_SIDE + W, H>(layout)), true)) || ...);
+    }
+
+    template<typename F, int... H>
+    bool _rows(int w, int h, const std::string& layout, F& f, std::integer_sequence<int, H...>) {
+        return (_row<MIN_SIDE + H>(w, h, layout, f, std::make_integer_sequence<int, MAX_SIDE - MIN_SIDE + 1>()) || ...);
+    }
+}
+
+// calls f with a board loaded from layout, if a board of its size is compiled in. returns false if not.
+// f is instantiated for every size, so it is best kept to a generic lambda taking auto&&.
+template<typename F>
+bool withBoard(const std::string& layout, F&& f) {
+    std::pair<int, int> s = layouts::size(layout);
+    if (!boards::fits(s.first, s.second)) {
+        return false;
+    }
+    return boards::_rows(s.first, s.second, layout, f, std::make_integer_sequence<int, boards::MAX_SIDE - boards::MIN_SIDE + 1>());
+}
+
+#endif
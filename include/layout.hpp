@@ -0,0 +1,27 @@
+// text layouts, the level format written by map::serialise(): one line per row from the top, '\n' between rows.
+// map, search::puzzle and the fixed-size boards all read it, and must agree on how big a level is.
+
+#ifndef LAYOUT_HPP
+#define LAYOUT_HPP
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+namespace layouts {
+
+    // the width and height of a text layout. the width is the longest row, and a trailing newline
+    // does not start another row.
+    inline std::pair<int, int> size(const std::string& layout) {
+        int w = 0, line = 0, h = layout.empty() ? 0 : 1;
+        for (char ch : layout) {
+            line = ch == '\n' ? 0 : line + 1;
+            h += ch == '\n';
+            w = std::max(w, line);
+        }
+        h -= !layout.empty() && layout.back() == '\n';
+        return {w, h};
+    }
+}
+
+#endif
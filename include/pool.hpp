@@ -0,0 +1,106 @@
+// a small, persistent thread pool for boxpush's batch modes.
+// jobs are "for every index in [0, n)", indices are handed out through one atomic counter.
+
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "trace.hpp"
+
+class pool {
+    private:
+        std::vector<std::thread> _threads;
+        std::mutex _lock;
+        std::condition_variable _wake, _done;
+        // the current job
+        std::function<void(size_t)> _job;
+        size_t _count = 0;
+        std::atomic<size_t> _next{0};
+        unsigned _busy = 0; // workers still inside the current job
+        unsigned _generation = 0; // bumped for every job so workers run each one once
+        bool _stopping = false;
+
+        // takes indices until there are none left.
+        void _drain() {
+            for (size_t i = _next++; i < _count; i = _next++) {
+                _job(i);
+            }
+        }
+
+        void _work() {
+            trace::name("worker");
+            unsigned seen = 0;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(_lock);
+                    _wake.wait(lock, [&]() { return _stopping || _generation != seen; });
+                    if (_stopping) {
+                        return;
+                    }
+                    seen = _generation;
+                }
+                _drain();
+                std::lock_guard<std::mutex> lock(_lock);
+                if (--_busy == 0) {
+                    _done.notify_all();
+                }
+            }
+        }
+
+    public:
+        // starts n worker threads, or one per hardware thread if n is 0.
+        explicit pool(unsigned n = 0) {
+            if (n == 0) {
+                n = std::max(1u, std::thread::hardware_concurrency());
+            }
+            // the calling thread works too, so one fewer is needed
+            for (unsigned i = 1; i < n; i++) {
+                _threads.emplace_back(&pool::_work, this);
+            }
+        }
+
+        ~pool() {
+            {
+                std::lock_guard<std::mutex> lock(_lock);
+                _stopping = true;
+            }
+            _wake.notify_all();
+            for (auto& t : _threads) {
+                t.join();
+            }
+        }
+
+        pool(const pool&) = delete;
+        pool& operator=(const pool&) = delete;
+
+        // the number of threads that run jobs, including the caller.
+        unsigned size() const {
+            return _threads.size() + 1;
+        }
+
+        // calls job(i) for every i in [0, n) across all threads and returns once they have all finished.
+        // job must be safe to call concurrently.
+        void run(size_t n, std::function<void(size_t)> job) {
+            {
+                std::lock_guard<std::mutex> lock(_lock);
+                _job = std::move(job);
+                _count = n;
+                _next = 0;
+                _busy = _threads.size();
+                _generation++;
+            }
+            _wake.notify_all();
+            _drain();
+            std::unique_lock<std::mutex> lock(_lock);
+            _done.wait(lock, [&]() { return _busy == 0; });
+        }
+};
+
+#endif
@@ -8,6 +8,16 @@
 #include <sstream>
 #include <vector>
 #include <map>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h> // _BitScanForward, msvc has no __builtin_ctz
+#endif
+#define PRETTY_SSE2
+#endif
 
 #define TEMPLATE "\x1B[%dm"
 #define RESET "\033[0m"
@@ -26,7 +36,11 @@ namespace pty {
     const std::string bright(const char * value);
 
     // removes all escape sequences from value
-    const std::string normal(const char * value);
+    const std::string normal(const std::string value);
+
+    // returns the number of terminal columns value takes up, ignoring escape sequences.
+    // wide (east asian and emoji) characters count as two, combining characters as none.
+    int width(const std::string& value);
 
     // paints the given value with the the fore/back/style names provided
     template<typename T>
@@ -87,23 +101,133 @@ namespace pty {
         return paint(value, "bright");
     }
 
+    // returns the index of the first escape character in value from i onwards, or size if there is none.
+    // checks 16 bytes at a time where sse2 is available.
+    inline size_t _nextEscape(const char * value, size_t i, size_t size) {
+#ifdef PRETTY_SSE2
+        const __m128i esc = _mm_set1_epi8('\x1B');
+        for (; i + 16 <= size; i += 16) {
+            int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(value + i)), esc));
+            if (mask != 0) {
+#ifdef _MSC_VER
+                unsigned long bit;
+                _BitScanForward(&bit, mask);
+                return i + bit;
+#else
+                return i + __builtin_ctz(mask);
+#endif
+            }
+        }
+#endif
+        const void * found = std::memchr(value + i, '\x1B', size - i);
+        return found == nullptr ? size : (const char *)found - value;
+    }
+
     const std::string normal(const std::string value) {
-        std::ostringstream oss;
-        bool zon = false;
-        for (int i = 0; i < value.size(); i++) {
-            if (value[i] == '\x1B') {
-                zon = true;
+        std::string out;
+        out.reserve(value.size());
+        const char * v = value.data();
+        size_t i = 0;
+        while (i < value.size()) {
+            // copy everything up to the next escape in one go, then skip to the end of the sequence
+            size_t esc = _nextEscape(v, i, value.size());
+            out.append(v + i, esc - i);
+            if (esc == value.size()) {
+                break;
             }
-            if (zon) {
-                if (value[i] == 'm') {
-                    zon = false;
+            const void * end = std::memchr(v + esc, 'm', value.size() - esc);
+            i = end == nullptr ? value.size() : (const char *)end - v + 1;
+        }
+        return out;
+    }
+
+    // ranges of code points that take up no columns, and that take up two, sorted by their first code point.
+    const uint32_t _zeroWidth[][2] = {
+        {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x0610, 0x061A}, {0x064B, 0x065F},
+        {0x0670, 0x0670}, {0x06D6, 0x06DC}, {0x06DF, 0x06E4}, {0x0900, 0x0903}, {0x093A, 0x094F},
+        {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF},
+        {0x200B, 0x200F}, {0x202A, 0x202E}, {0x2060, 0x2064}, {0x20D0, 0x20FF}, {0xFE00, 0xFE0F},
+        {0xFE20, 0xFE2F}, {0xFEFF, 0xFEFF}, {0x1F3FB, 0x1F3FF}, {0xE0000, 0xE01EF},
+    };
+    const uint32_t _doubleWidth[][2] = {
+        {0x1100, 0x115F}, {0x231A, 0x231B}, {0x2329, 0x232A}, {0x23E9, 0x23EC}, {0x23F0, 0x23F0},
+        {0x23F3, 0x23F3}, {0x25FD, 0x25FE}, {0x2614, 0x2615}, {0x2648, 0x2653}, {0x267F, 0x267F},
+        {0x2693, 0x2693}, {0x26A1, 0x26A1}, {0x26AA, 0x26AB}, {0x26BD, 0x26BE}, {0x26C4, 0x26C5},
+        {0x26CE, 0x26CE}, {0x26D4, 0x26D4}, {0x26EA, 0x26EA}, {0x26F2, 0x26F3}, {0x26F5, 0x26F5},
+        {0x26FA, 0x26FA}, {0x26FD, 0x26FD}, {0x2705, 0x2705}, {0x270A, 0x270B}, {0x2728, 0x2728},
+        {0x274C, 0x274C}, {0x274E, 0x274E}, {0x2753, 0x2755}, {0x2757, 0x2757}, {0x2795, 0x2797},
+        {0x27B0, 0x27B0}, {0x27BF, 0x27BF}, {0x2B1B, 0x2B1C}, {0x2B50, 0x2B50}, {0x2B55, 0x2B55},
+        {0x2E80, 0x303E}, {0x3041, 0x33FF}, {0x3400, 0x4DBF}, {0x4E00, 0x9FFF}, {0xA000, 0xA4CF},
+        {0xA960, 0xA97F}, {0xAC00, 0xD7A3}, {0xF900, 0xFAFF}, {0xFE10, 0xFE19}, {0xFE30, 0xFE6F},
+        {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x16FE0, 0x18AFF}, {0x1B000, 0x1B2FF}, {0x1F004, 0x1F004},
+        {0x1F0CF, 0x1F0CF}, {0x1F18E, 0x1F18E}, {0x1F191, 0x1F19A}, {0x1F200, 0x1F251}, {0x1F300, 0x1F320},
+        {0x1F32D, 0x1F335}, {0x1F337, 0x1F37C}, {0x1F37E, 0x1F393}, {0x1F3A0, 0x1F3CA}, {0x1F3CF, 0x1F3D3},
+        {0x1F3E0, 0x1F3F0}, {0x1F3F4, 0x1F3F4}, {0x1F3F8, 0x1F3FA}, {0x1F400, 0x1F43E}, {0x1F440, 0x1F440},
+        {0x1F442, 0x1F4FC}, {0x1F4FF, 0x1F53D}, {0x1F54B, 0x1F54E}, {0x1F550, 0x1F567}, {0x1F57A, 0x1F57A},
+        {0x1F595, 0x1F596}, {0x1F5A4, 0x1F5A4}, {0x1F5FB, 0x1F64F}, {0x1F680, 0x1F6C5}, {0x1F6CC, 0x1F6CC},
+        {0x1F6D0, 0x1F6D2}, {0x1F6D5, 0x1F6D7}, {0x1F6EB, 0x1F6EC}, {0x1F6F4, 0x1F6FC}, {0x1F7E0, 0x1F7EB},
+        {0x1F90C, 0x1F93A}, {0x1F93C, 0x1F945}, {0x1F947, 0x1F9FF}, {0x1FA70, 0x1FAFF}, {0x20000, 0x3FFFD},
+    };
+
+    // is c within one of the ranges in table?
+    template<size_t N>
+    bool _inRanges(uint32_t c, const uint32_t (&table)[N][2]) {
+        size_t low = 0, high = N;
+        while (low < high) {
+            size_t mid = (low + high) / 2;
+            if (c > table[mid][1]) {
+                low = mid + 1;
+            } else if (c < table[mid][0]) {
+                high = mid;
+            } else {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int width(const std::string& value) {
+        const unsigned char * v = (const unsigned char *)value.data();
+        size_t size = value.size();
+        int columns = 0;
+        bool joined = false; // the last code point was a zero width joiner, so this one joins its glyph
+        size_t i = 0;
+        while (i < size) {
+            unsigned char b = v[i];
+            // plain ascii is the common case
+            if (b < 0x80) {
+                if (b == 0x1B) {
+                    const void * end = std::memchr(v + i, 'm', size - i);
+                    i = end == nullptr ? size : (const unsigned char *)end - v + 1;
+                    continue;
                 }
+                columns += b >= 0x20 && b != 0x7F;
+                joined = false;
+                i++;
                 continue;
-            } else {
-                oss << value[i];
             }
+            // decode one utf-8 sequence, anything malformed counts as a single column
+            int length = b >= 0xF0 ? 4 : b >= 0xE0 ? 3 : b >= 0xC0 ? 2 : 1;
+            uint32_t c = length == 1 ? b : b & (0x7F >> length);
+            for (int k = 1; k < length; k++) {
+                if (i + k >= size || (v[i + k] & 0xC0) != 0x80) {
+                    length = 1;
+                    c = 0xFFFD;
+                    break;
+                }
+                c = (c << 6) | (v[i + k] & 0x3F);
+            }
+            i += length;
+            if (c == 0x200D) {
+                joined = true;
+                continue;
+            }
+            if (!joined && !_inRanges(c, _zeroWidth)) {
+                columns += _inRanges(c, _doubleWidth) ? 2 : 1;
+            }
+            joined = false;
         }
-        return oss.str();
+        return columns;
     }
 
     template<typename T>
@@ -0,0 +1,173 @@
+// the boxpush replay format: a small header followed by the moves, 2 bits each and run-length encoded.
+//
+// header (little endian, 32 bytes):
+//   "BXR1", width (u16), height (u16), seed (u64), level hash (u64), moves (u32), payload bytes (u32)
+// payload, a sequence of packets:
+//   0nnnnnnn              - n+1 moves follow, packed 4 to a byte from the lowest bits up
+//   1ddnnnnn [varint]     - direction d repeated n+4 times, if n is 31 a varint follows with the rest of the length
+// directions are 0 (w), 1 (a), 2 (s) and 3 (d).
+
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace replay {
+
+    const size_t HEADER_SIZE = 32;
+    // runs shorter than this are cheaper to store as literals
+    const uint32_t MIN_RUN = 4;
+    // replays claiming more moves than this are rejected rather than decoded
+    const uint32_t MAX_MOVES = 1 << 24;
+
+    struct header {
+        uint16_t width = 0, height = 0;
+        uint64_t seed = 0;
+        uint64_t levelHash = 0;
+        uint32_t moves = 0;
+        uint32_t bytes = 0; // size of the payload that follows the header
+    };
+
+    inline void _put(std::vector<uint8_t>& out, uint64_t v, int bytes) {
+        for (int i = 0; i < bytes; i++) {
+            out.push_back((v >> (i*8)) & 0xFF);
+        }
+    }
+
+    inline uint64_t _get(const uint8_t * in, int bytes) {
+        uint64_t v = 0;
+        for (int i = 0; i < bytes; i++) {
+            v |= (uint64_t)in[i] << (i*8);
+        }
+        return v;
+    }
+
+    // appends moves (each 0-3) to out in the packet format above.
+    inline void encode(const std::vector<uint8_t>& moves, std::vector<uint8_t>& out) {
+        size_t i = 0;
+        while (i < moves.size()) {
+            // measure the run starting here
+            size_t run = 1;
+            while (i + run < moves.size() && moves[i + run] == moves[i]) {
+                run++;
+            }
+            if (run >= MIN_RUN) {
+                uint64_t extra = run - MIN_RUN;
+                out.push_back(0x80 | (moves[i] << 5) | (extra < 31 ? extra : 31));
+                if (extra >= 31) {
+                    // varint of what did not fit in the packet byte
+                    for (extra -= 31; extra >= 0x80; extra >>= 7) {
+                        out.push_back((extra & 0x7F) | 0x80);
+                    }
+                    out.push_back(extra);
+                }
+                i += run;
+                continue;
+            }
+            // gather literals until the next worthwhile run
+            size_t start = i;
+            while (i < moves.size() && i - start < 128) {
+                size_t r = 1;
+                while (i + r < moves.size() && moves[i + r] == moves[i] && r < MIN_RUN) {
+                    r++;
+                }
+                if (r >= MIN_RUN) {
+                    break;
+                }
+                i++;
+            }
+            size_t n = i - start;
+            out.push_back(n - 1);
+            for (size_t j = 0; j < n; j += 4) {
+                uint8_t packed = 0;
+                for (size_t k = 0; k < 4 && j + k < n; k++) {
+                    packed |= moves[start + j + k] << (k*2);
+                }
+                out.push_back(packed);
+            }
+        }
+    }
+
+    // decodes size bytes of payload into out, which is cleared first.
+    // returns false if the payload is malformed or does not hold exactly expected moves.
+    inline bool decode(const uint8_t * in, size_t size, uint32_t expected, std::vector<uint8_t>& out) {
+        out.clear();
+        if (expected > MAX_MOVES) {
+            return false;
+        }
+        size_t i = 0;
+        while (i < size) {
+            uint8_t p = in[i++];
+            if (p & 0x80) {
+                uint64_t run = (p & 0x1F) + MIN_RUN;
+                if ((p & 0x1F) == 31) {
+                    uint64_t extra = 0;
+                    for (int shift = 0; ; shift += 7) {
+                        if (i >= size || shift > 28) {
+                            return false;
+                        }
+                        uint8_t b = in[i++];
+                        extra |= (uint64_t)(b & 0x7F) << shift;
+                        if (!(b & 0x80)) {
+                            break;
+                        }
+                    }
+                    run += extra;
+                }
+                if (out.size() + run > expected) {
+                    return false;
+                }
+                out.insert(out.end(), run, (p >> 5) & 3);
+            } else {
+                size_t n = p + 1;
+                if (i + (n+3)/4 > size || out.size() + n > expected) {
+                    return false;
+                }
+                for (size_t k = 0; k < n; k++) {
+                    out.push_back((in[i + k/4] >> ((k%4)*2)) & 3);
+                }
+                i += (n+3)/4;
+            }
+        }
+        return out.size() == expected;
+    }
+
+    // appends a whole replay, header and payload, to out.
+    inline void write(std::vector<uint8_t>& out, header h, const std::vector<uint8_t>& moves) {
+        std::vector<uint8_t> payload;
+        encode(moves, payload);
+        h.moves = moves.size();
+        h.bytes = payload.size();
+        out.insert(out.end(), {'B', 'X', 'R', '1'});
+        _put(out, h.width, 2);
+        _put(out, h.height, 2);
+        _put(out, h.seed, 8);
+        _put(out, h.levelHash, 8);
+        _put(out, h.moves, 4);
+        _put(out, h.bytes, 4);
+        out.insert(out.end(), payload.begin(), payload.end());
+    }
+
+    // reads the header at in, returns false if there is not a whole replay in the size bytes available.
+    inline bool readHeader(const uint8_t * in, size_t size, header& h) {
+        if (size < HEADER_SIZE || std::memcmp(in, "BXR1", 4) != 0) {
+            return false;
+        }
+        h.width = _get(in + 4, 2);
+        h.height = _get(in + 6, 2);
+        h.seed = _get(in + 8, 8);
+        h.levelHash = _get(in + 16, 8);
+        h.moves = _get(in + 24, 4);
+        h.bytes = _get(in + 28, 4);
+        return size - HEADER_SIZE >= h.bytes;
+    }
+
+    // the movement key for a direction.
+    inline char toKey(uint8_t direction) {
+        return "wasd"[direction & 3];
+    }
+}
+
+#endif
@@ -0,0 +1,1076 @@
+// boxpush's search engine: the game rules over compact bitset states, and breadth first solvers on top of them.
+// the rules are the same as map::move, a chain of boxes is pushed together, a box that reaches a target is
+// captured there and can never move again, and a captured box blocks everything.
+//
+// cells are numbered as in map, (y-1)*width + x with y = 1 at the bottom, and directions as in replays.
+
+#ifndef SEARCH_HPP
+#define SEARCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "arena.hpp"
+#include "layout.hpp"
+#include "trace.hpp"
+#include "tt.hpp"
+
+namespace search {
+
+    const int UP = 0, LEFT = 1, DOWN = 2, RIGHT = 3;
+
+    inline bool test(const uint64_t * bits, int c) {
+        return (bits[c >> 6] >> (c & 63)) & 1;
+    }
+    inline void set(uint64_t * bits, int c) {
+        bits[c >> 6] |= 1ULL << (c & 63);
+    }
+    inline void clear(uint64_t * bits, int c) {
+        bits[c >> 6] &= ~(1ULL << (c & 63));
+    }
+    inline int count(const uint64_t * bits, int words) {
+        int n = 0;
+        for (int i = 0; i < words; i++) {
+            n += __builtin_popcountll(bits[i]);
+        }
+        return n;
+    }
+
+    // everything about a level that never changes during a search.
+    // a state is two bitsets of words each: the boxes that can still move, then the captured boxes.
+    struct puzzle {
+        int width = 0, height = 0, cells = 0;
+        int words = 0; // 64-bit words per bitset
+        int player = -1; // the player's starting cell
+        int totalScore = 0; // the number of targets, captured or not
+        int boxCount = 0; // boxes, captured or not
+        std::vector<uint64_t> start; // the starting state
+        std::vector<uint64_t> targets; // targets that have not been captured at the start
+        std::vector<uint64_t> deadMask; // cells a box can never be pushed to a target from
+        int deadCount = 0;
+        std::vector<uint64_t> zobrist; // random keys for a box, a captured box and the player on every cell
+
+        // the shape of the level, from its walls: the edges of the map and the boxes captured at the start.
+        // a tunnel cell is only one cell wide, VERTICAL if it is walled on the left and right and HORIZONTAL
+        // if above and below. the open cells between tunnels make up rooms, and a room with targets that can
+        // only be entered through one tunnel cell is a goal room.
+        static const uint8_t VERTICAL = 1, HORIZONTAL = 2;
+        struct room {
+            int cells = 0;
+            int entrance = -1; // the tunnel cell leading in, if there is only one
+            std::vector<int> fill; // a goal room's targets, the furthest from the entrance first
+        };
+        std::vector<uint8_t> tunnel; // per cell
+        std::vector<int> roomOf; // per cell, -1 for tunnels and walls
+        std::vector<room> rooms;
+        int tunnelCount = 0, goalRoomCount = 0;
+
+        // returns true if c is off the map or a box was captured there, given the captured bitset.
+        bool wall(const uint64_t * captured, int c) const {
+            return c == -1 || test(captured, c);
+        }
+
+        // returns true if the room r is a goal room.
+        bool goalRoom(int r) const {
+            return r != -1 && !rooms[r].fill.empty();
+        }
+
+        // returns the cell next to c in direction d, or -1 if that is off the map.
+        int neighbour(int c, int d) const {
+            switch (d) {
+                case UP: return c + width < cells ? c + width : -1;
+                case LEFT: return c % width > 0 ? c - 1 : -1;
+                case DOWN: return c >= width ? c - width : -1;
+                default: return c % width < width - 1 ? c + 1 : -1;
+            }
+        }
+
+        // loads a level from the text written by map::serialise().
+        explicit puzzle(const std::string& layout) {
+            std::tie(width, height) = layouts::size(layout);
+            cells = width * height;
+            words = (cells + 63) / 64;
+            start.assign(words * 2, 0);
+            targets.assign(words, 0);
+            int x = 0, r = 0;
+            for (char ch : layout) {
+                if (ch == '\n') {
+                    x = 0;
+                    r++;
+                    continue;
+                }
+                int c = (height - 1 - r) * width + x;
+                if (ch == '@' || ch == '+') {
+                    player = c;
+                }
+                if (ch == '.' || ch == '+') {
+                    set(targets.data(), c);
+                }
+                if (ch == '$') {
+                    set(start.data(), c);
+                }
+                if (ch == '*') {
+                    set(start.data() + words, c);
+                }
+                totalScore += ch == '.' || ch == '+' || ch == '*';
+                boxCount += ch == '$' || ch == '*';
+                x++;
+            }
+
+            // keys for hashing states, from a fixed seed so hashes agree between runs
+            zobrist.resize(cells * 3);
+            uint64_t z = 0x2545f4914f6cdd1dULL;
+            for (auto& key : zobrist) {
+                z += 0x9e3779b97f4a7c15ULL;
+                uint64_t k = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                k = (k ^ (k >> 27)) * 0x94d049bb133111ebULL;
+                key = k ^ (k >> 31);
+            }
+
+            // a box can only get to a target if it can be pulled back from one, with room behind for the player
+            std::vector<char> live(cells, 0);
+            std::vector<int> queue;
+            const uint64_t * captured = start.data() + words;
+            for (int c = 0; c < cells; c++) {
+                if (test(targets.data(), c)) {
+                    live[c] = 1;
+                    queue.push_back(c);
+                }
+            }
+            for (size_t i = 0; i < queue.size(); i++) {
+                for (int d = 0; d < 4; d++) {
+                    int from = neighbour(queue[i], d);
+                    int behind = from == -1 ? -1 : neighbour(from, d);
+                    if (behind != -1 && !live[from] && !test(captured, from) && !test(captured, behind)) {
+                        live[from] = 1;
+                        queue.push_back(from);
+                    }
+                }
+            }
+            deadMask.assign(words, 0);
+            for (int c = 0; c < cells; c++) {
+                if (!live[c] && !test(captured, c)) {
+                    set(deadMask.data(), c);
+                    deadCount++;
+                }
+            }
+            _analyse();
+        }
+
+        // finds the tunnels and rooms.
+        void _analyse() {
+            const uint64_t * captured = start.data() + words;
+            tunnel.assign(cells, 0);
+            for (int c = 0; c < cells; c++) {
+                if (test(captured, c)) {
+                    continue;
+                }
+                if (wall(captured, neighbour(c, LEFT)) && wall(captured, neighbour(c, RIGHT))) {
+                    tunnel[c] |= VERTICAL;
+                }
+                if (wall(captured, neighbour(c, UP)) && wall(captured, neighbour(c, DOWN))) {
+                    tunnel[c] |= HORIZONTAL;
+                }
+                tunnelCount += tunnel[c] != 0;
+            }
+            roomOf.assign(cells, -1);
+            rooms.clear();
+            std::vector<int> queue;
+            for (int c = 0; c < cells; c++) {
+                if (roomOf[c] != -1 || tunnel[c] || test(captured, c)) {
+                    continue;
+                }
+                int r = rooms.size();
+                rooms.emplace_back();
+                room& rm = rooms.back();
+                std::vector<int> entrances, found;
+                queue.assign(1, c);
+                roomOf[c] = r;
+                for (size_t i = 0; i < queue.size(); i++) {
+                    rm.cells++;
+                    if (test(targets.data(), queue[i])) {
+                        found.push_back(queue[i]);
+                    }
+                    for (int d = 0; d < 4; d++) {
+                        int n = neighbour(queue[i], d);
+                        if (wall(captured, n) || roomOf[n] != -1) {
+                            continue;
+                        }
+                        if (tunnel[n]) {
+                            if (std::find(entrances.begin(), entrances.end(), n) == entrances.end()) {
+                                entrances.push_back(n);
+                            }
+                            continue;
+                        }
+                        roomOf[n] = r;
+                        queue.push_back(n);
+                    }
+                }
+                if (entrances.size() != 1 || found.empty()) {
+                    continue;
+                }
+                // a dead end off the room is not a way in, the tunnel has to lead to some other room
+                bool leads = false;
+                std::vector<char> seen(cells, 0);
+                queue.assign(1, entrances[0]);
+                seen[entrances[0]] = 1;
+                for (size_t i = 0; i < queue.size() && !leads; i++) {
+                    for (int d = 0; d < 4; d++) {
+                        int n = neighbour(queue[i], d);
+                        if (wall(captured, n) || seen[n] || roomOf[n] == r) {
+                            continue;
+                        }
+                        seen[n] = 1;
+                        leads |= !tunnel[n];
+                        queue.push_back(n);
+                    }
+                }
+                if (!leads) {
+                    continue;
+                }
+                // fill the room from the back, so no box that arrives later has to get past a captured one
+                rm.entrance = entrances[0];
+                std::vector<int> distance(cells, -1);
+                queue.assign(1, rm.entrance);
+                distance[rm.entrance] = 0;
+                for (size_t i = 0; i < queue.size(); i++) {
+                    for (int d = 0; d < 4; d++) {
+                        int n = neighbour(queue[i], d);
+                        if (n != -1 && roomOf[n] == r && distance[n] == -1) {
+                            distance[n] = distance[queue[i]] + 1;
+                            queue.push_back(n);
+                        }
+                    }
+                }
+                std::stable_sort(found.begin(), found.end(), [&](int a, int b) { return distance[a] > distance[b]; });
+                rm.fill = found;
+                goalRoomCount++;
+            }
+        }
+
+        // hashes a state with the player on cell player.
+        uint64_t hash(const uint64_t * bits, int player) const {
+            uint64_t h = zobrist[player * 3 + 2];
+            for (int i = 0; i < words * 2; i++) {
+                for (uint64_t b = bits[i]; b != 0; b &= b - 1) {
+                    int c = (i % words) * 64 + __builtin_ctzll(b);
+                    h ^= zobrist[c * 3 + (i >= words)];
+                }
+            }
+            return h;
+        }
+
+        // returns true once every target has been captured.
+        bool solved(const uint64_t * bits) const {
+            return count(bits + words, words) == totalScore;
+        }
+
+        // returns true if too few of the movable boxes can still reach a target to finish the level.
+        bool deadlocked(const uint64_t * bits) const {
+            int needed = totalScore - count(bits + words, words);
+            int usable = 0;
+            for (int i = 0; i < words; i++) {
+                usable += __builtin_popcountll(bits[i] & ~deadMask[i]);
+            }
+            return usable < needed;
+        }
+    };
+
+    // moves the player on cell player in direction d, pushing any chain of boxes in front of them, as map::move does.
+    // returns the player's new cell, or -1 if nothing could move. pushed is set to the number of boxes moved.
+    inline int step(const puzzle& p, uint64_t * bits, int player, int d, int& pushed) {
+        const uint64_t * captured = bits + p.words;
+        pushed = 0;
+        int first = -1;
+        int n = p.neighbour(player, d);
+        while (true) {
+            if (n == -1 || test(captured, n)) {
+                return -1;
+            }
+            if (!test(bits, n)) {
+                break;
+            }
+            first = first == -1 ? n : first;
+            pushed++;
+            n = p.neighbour(n, d);
+        }
+        // a contiguous chain moving one cell is the same as its first box jumping to the far end
+        if (first != -1) {
+            clear(bits, first);
+            set(test(p.targets.data(), n) ? bits + p.words : bits, n);
+        }
+        return p.neighbour(player, d);
+    }
+
+    // flood fills and path finds the cells the player can walk to without pushing anything.
+    // scratch space is kept between calls so repeated floods do not allocate.
+    struct walker {
+        std::vector<uint32_t> mark; // cells marked with the current stamp have been reached
+        uint32_t stamp = 0;
+        std::vector<int> queue; // reached cells, in the order they were reached
+        std::vector<int> from;
+
+        // floods from player, returns the lowest cell reached.
+        int flood(const puzzle& p, const uint64_t * bits, int player) {
+            if (mark.size() != (size_t)p.cells) {
+                mark.assign(p.cells, 0);
+                from.assign(p.cells, -1);
+                stamp = 0;
+            }
+            if (++stamp == 0) {
+                std::fill(mark.begin(), mark.end(), 0);
+                stamp = 1;
+            }
+            queue.clear();
+            queue.push_back(player);
+            mark[player] = stamp;
+            from[player] = -1;
+            int lowest = player;
+            for (size_t i = 0; i < queue.size(); i++) {
+                for (int d = 0; d < 4; d++) {
+                    int n = p.neighbour(queue[i], d);
+                    if (n != -1 && mark[n] != stamp && !test(bits, n) && !test(bits + p.words, n)) {
+                        mark[n] = stamp;
+                        from[n] = queue[i];
+                        queue.push_back(n);
+                        lowest = std::min(lowest, n);
+                    }
+                }
+            }
+            return lowest;
+        }
+
+        bool reached(int c) const {
+            return mark[c] == stamp;
+        }
+
+        // appends the directions of the walk to c found by the last flood onto path.
+        void walkTo(const puzzle& p, int c, std::vector<uint8_t>& path) {
+            size_t at = path.size();
+            for (; from[c] != -1; c = from[c]) {
+                int diff = c - from[c];
+                path.push_back(diff == p.width ? UP : diff == -p.width ? DOWN : diff == 1 ? RIGHT : LEFT);
+            }
+            std::reverse(path.begin() + at, path.end());
+        }
+    };
+
+    // carries on a push that has just moved a single box from the player's cell in direction d, if the box went
+    // somewhere with only one sensible way on:
+    //   - into a tunnel with the player behind it, also in the tunnel: the box is pushed on until it leaves.
+    //     walls here include boxes captured during the search, not only those captured at the start.
+    //   - through the entrance of a goal room: the box is pushed to the room's next empty target, if it can get there.
+    // both only depend on the state, so a search can store the first push and redo the rest when it traces a path.
+    // like most solvers' macros this gives up the rare solution that needs a box parked in a tunnel or room.
+    // returns the player's cell afterwards. the moves made are appended to path and counted in pushes, if given.
+    inline int macro(const puzzle& p, uint64_t * bits, int player, int d, walker& walk,
+            std::vector<uint8_t> * path = nullptr, int * pushes = nullptr) {
+        const uint64_t * captured = bits + p.words;
+        auto tunnelled = [&](int c) {
+            return d == UP || d == DOWN
+                ? p.wall(captured, p.neighbour(c, LEFT)) && p.wall(captured, p.neighbour(c, RIGHT))
+                : p.wall(captured, p.neighbour(c, UP)) && p.wall(captured, p.neighbour(c, DOWN));
+        };
+        auto push = [&](int from, int dir) {
+            if (path != nullptr) {
+                walk.flood(p, bits, player);
+                walk.walkTo(p, from, *path);
+                path->push_back(dir);
+            }
+            if (pushes != nullptr) {
+                ++*pushes;
+            }
+            int pushed;
+            player = step(p, bits, from, dir, pushed);
+        };
+        int box = p.neighbour(player, d);
+        if (box == -1 || !test(bits, box)) {
+            return player; // captured, nothing more to do
+        }
+        while (tunnelled(player) && tunnelled(box)) {
+            int n = p.neighbour(box, d);
+            if (p.wall(captured, n) || test(bits, n)) {
+                return player;
+            }
+            push(player, d);
+            box = n;
+            if (test(captured, box)) {
+                return player;
+            }
+        }
+
+        int r = p.roomOf[box];
+        if (!p.goalRoom(r) || player != p.rooms[r].entrance) {
+            return player;
+        }
+        int target = -1;
+        for (int t : p.rooms[r].fill) {
+            if (!test(captured, t)) {
+                target = t;
+                break;
+            }
+        }
+        if (target == -1) {
+            return player;
+        }
+        // breadth first over where the box is and which way it was last pushed, only inside the room.
+        // any other target would capture it on the way, so they are avoided.
+        std::vector<uint64_t> board(bits, bits + p.words * 2);
+        clear(board.data(), box);
+        std::vector<int> parent(p.cells * 4, -2);
+        std::vector<int> queue(1, box * 4 + d);
+        parent[box * 4 + d] = -1;
+        int found = -1;
+        for (size_t i = 0; i < queue.size() && found == -1; i++) {
+            int x = queue[i] / 4, behind = p.neighbour(x, (queue[i] % 4 + 2) % 4);
+            set(board.data(), x);
+            walk.flood(p, board.data(), behind);
+            clear(board.data(), x);
+            for (int e = 0; e < 4; e++) {
+                int from = p.neighbour(x, (e + 2) % 4), to = p.neighbour(x, e);
+                if (from == -1 || !walk.reached(from) || to == -1 || p.roomOf[to] != r || test(board.data(), to)
+                        || test(captured, to) || (test(p.targets.data(), to) && to != target)) {
+                    continue;
+                }
+                int next = to * 4 + e;
+                if (parent[next] != -2) {
+                    continue;
+                }
+                parent[next] = queue[i];
+                if (to == target) {
+                    found = next;
+                    break;
+                }
+                queue.push_back(next);
+            }
+        }
+        if (found == -1) {
+            return player;
+        }
+        std::vector<int> chain;
+        for (int at = found; parent[at] != -1; at = parent[at]) {
+            chain.push_back(at);
+        }
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            int e = *it % 4;
+            push(p.neighbour(parent[*it] / 4, (e + 2) % 4), e);
+        }
+        return player;
+    }
+
+    // a lower bound on the box moves left to solve a state, from a minimum cost assignment of boxes to targets.
+    // the cost of a box and a target is the pushes the box would need to get there on an otherwise empty board,
+    // taken from tables built once per level. every box must end on its own target, so the cheapest assignment
+    // bounds the box moves left. it is no bound on pushes, as one push can move a whole chain of boxes.
+    //
+    // assignments are kept with their potentials (the hungarian algorithm's dual), so after a push, which only ever
+    // moves one box as far as the assignment is concerned, the new optimum takes one O(n^2) augmenting step
+    // rather than an O(n^3) solve from scratch. a node's assignment is a flat array of slots() integers.
+    class matcher {
+        public:
+            // the cost of a box that cannot reach a target. an assignment costing this much or more is a deadlock.
+            static constexpr int32_t BIG = 1 << 16;
+
+        private:
+            static constexpr int32_t INF = 1 << 28;
+            const puzzle& _p;
+            int _targets = 0; // targets not captured at the start, the first rows
+            int _n = 0; // rows and columns, padded to the larger of the targets and the movable boxes
+            std::vector<int> _targetCell;
+            std::vector<uint16_t> _distance; // pushes from every cell to every target, 0xFFFF if it cannot get there
+            std::vector<int32_t> _minv;
+            std::vector<int> _way;
+            std::vector<char> _used;
+
+            // an assignment is laid out as u[n+1], v[n+1], p[n+1], cell[n+1], all 1-indexed as in the usual
+            // hungarian algorithm. p[j] is the row of column j, and cell[j] is its box's cell, CAPTURED if the box
+            // has been captured there, or -1 for padding.
+            static constexpr int CAPTURED = 1 << 30;
+            int32_t * _u(int32_t * a) const { return a; }
+            int32_t * _v(int32_t * a) const { return a + _n + 1; }
+            int32_t * _row(int32_t * a) const { return a + (_n + 1) * 2; }
+            int32_t * _cell(int32_t * a) const { return a + (_n + 1) * 3; }
+
+            int32_t _cost(int row, int32_t cell) const {
+                if (cell == -1) {
+                    return row <= _targets ? BIG : 0;
+                }
+                if (cell & CAPTURED) {
+                    // a captured box stays on its target for good
+                    return row <= _targets && _targetCell[row - 1] == (cell & ~CAPTURED) ? 0 : BIG;
+                }
+                if (row > _targets) {
+                    return 0; // boxes with no target to go to
+                }
+                uint16_t d = _distance[(size_t)(row - 1) * _p.cells + cell];
+                return d == 0xFFFF ? BIG : d;
+            }
+
+            // finds the best place for row i, which must be the only unassigned row, by one augmenting path.
+            void _augment(int32_t * a, int i) {
+                int32_t * u = _u(a), * v = _v(a), * p = _row(a), * cell = _cell(a);
+                std::fill(_minv.begin(), _minv.end(), INF);
+                std::fill(_used.begin(), _used.end(), 0);
+                p[0] = i;
+                int j0 = 0;
+                do {
+                    _used[j0] = 1;
+                    int i0 = p[j0], j1 = 0;
+                    int32_t delta = INF;
+                    for (int j = 1; j <= _n; j++) {
+                        if (!_used[j]) {
+                            int32_t cur = _cost(i0, cell[j]) - u[i0] - v[j];
+                            if (cur < _minv[j]) {
+                                _minv[j] = cur;
+                                _way[j] = j0;
+                            }
+                            if (_minv[j] < delta) {
+                                delta = _minv[j];
+                                j1 = j;
+                            }
+                        }
+                    }
+                    for (int j = 0; j <= _n; j++) {
+                        if (_used[j]) {
+                            u[p[j]] += delta;
+                            v[j] -= delta;
+                        } else {
+                            _minv[j] -= delta;
+                        }
+                    }
+                    j0 = j1;
+                } while (p[j0] != 0);
+                do {
+                    int j1 = _way[j0];
+                    p[j0] = p[j1];
+                    j0 = j1;
+                } while (j0 != 0);
+            }
+
+        public:
+            explicit matcher(const puzzle& p) : _p(p) {
+                const uint64_t * captured = p.start.data() + p.words;
+                for (int c = 0; c < p.cells; c++) {
+                    if (test(p.targets.data(), c) && !test(captured, c)) {
+                        _targetCell.push_back(c);
+                    }
+                }
+                _targets = _targetCell.size();
+                _n = std::max(_targets, count(p.start.data(), p.words));
+                _minv.resize(_n + 1);
+                _way.resize(_n + 1);
+                _used.resize(_n + 1);
+                // pull a box away from every target, as for dead squares, counting the pulls
+                _distance.assign((size_t)_targets * p.cells, 0xFFFF);
+                std::vector<int> queue;
+                for (int t = 0; t < _targets; t++) {
+                    uint16_t * d = &_distance[(size_t)t * p.cells];
+                    queue.assign(1, _targetCell[t]);
+                    d[_targetCell[t]] = 0;
+                    for (size_t i = 0; i < queue.size(); i++) {
+                        for (int dir = 0; dir < 4; dir++) {
+                            int from = p.neighbour(queue[i], dir);
+                            int behind = from == -1 ? -1 : p.neighbour(from, dir);
+                            if (behind != -1 && d[from] == 0xFFFF && !test(captured, from) && !test(captured, behind)) {
+                                d[from] = d[queue[i]] + 1;
+                                queue.push_back(from);
+                            }
+                        }
+                    }
+                }
+            }
+
+            // the integers an assignment takes up.
+            size_t slots() const {
+                return (size_t)(_n + 1) * 4;
+            }
+
+            // pushes from c to the ith target on an empty board, or -1 if it can never get there.
+            int distance(int i, int c) const {
+                uint16_t d = _distance[(size_t)i * _p.cells + c];
+                return d == 0xFFFF ? -1 : d;
+            }
+
+            // solves the state in bits from scratch into a, in O(n^3).
+            void solve(const uint64_t * bits, int32_t * a) {
+                std::fill(a, a + slots(), 0);
+                int32_t * cell = _cell(a);
+                int j = 1;
+                for (int i = 0; i < _p.words * 2; i++) {
+                    for (uint64_t b = bits[i]; b != 0; b &= b - 1) {
+                        int c = (i % _p.words) * 64 + __builtin_ctzll(b);
+                        bool captured = i >= _p.words;
+                        // boxes captured at the start take no part, their targets are not rows
+                        if (captured && test(_p.start.data() + _p.words, c)) {
+                            continue;
+                        }
+                        if (j <= _n) {
+                            cell[j++] = captured ? c | CAPTURED : c;
+                        }
+                    }
+                }
+                for (; j <= _n; j++) {
+                    cell[j] = -1;
+                }
+                for (int i = 1; i <= _n; i++) {
+                    _augment(a, i);
+                }
+            }
+
+            // copies the assignment parent into a and moves the box on from to to, captured there or not,
+            // in O(n^2). if from is not one of its boxes, a is solved from the state in bits instead.
+            void update(const int32_t * parent, int from, int to, bool captured, const uint64_t * bits, int32_t * a) {
+                std::copy(parent, parent + slots(), a);
+                int32_t * u = _u(a), * v = _v(a), * p = _row(a), * cell = _cell(a);
+                int j = 1;
+                while (j <= _n && cell[j] != from) {
+                    j++;
+                }
+                if (j > _n) {
+                    solve(bits, a);
+                    return;
+                }
+                cell[j] = captured ? to | CAPTURED : to;
+                // free the column's row, make the column's potential feasible for its new costs, then place the row again
+                int i = p[j];
+                p[j] = 0;
+                int32_t best = INF;
+                for (int r = 1; r <= _n; r++) {
+                    best = std::min(best, _cost(r, cell[j]) - u[r]);
+                }
+                v[j] = best;
+                _augment(a, i);
+            }
+
+            // the box moves the assignment a needs, BIG or more if it is a deadlock.
+            int32_t cost(const int32_t * a) const {
+                const int32_t * p = a + (_n + 1) * 2, * cell = a + (_n + 1) * 3;
+                int32_t total = 0;
+                for (int j = 1; j <= _n; j++) {
+                    total += _cost(p[j], cell[j]);
+                }
+                return total;
+            }
+
+            // a lower bound on the box moves left from the assignment a, or -1 if it is a deadlock.
+            int bound(const int32_t * a) const {
+                int32_t total = cost(a);
+                return total >= BIG ? -1 : total;
+            }
+    };
+
+    // the outcome of a search.
+    struct result {
+        bool solved = false;
+        bool exhausted = false; // the node limit was hit before the search finished
+        bool timedOut = false; // the deadline passed first, the search can be resumed
+        int pushes = -1, moves = -1; // of the solution, -1 if there is none
+        int boxMoves = -1; // pushes counting every box in a chain, only the same as pushes when there are none
+        size_t expanded = 0, generated = 0;
+        std::vector<uint8_t> path; // the solution's moves, as directions
+
+        // successors generated per expanded node.
+        double branching() const {
+            return expanded == 0 ? 0 : (double)generated / expanded;
+        }
+    };
+
+    // the memory a solver works in: node storage, the transposition table and flood scratch space.
+    // a workspace outlives the solvers that use it, so a thread checking level after level allocates once
+    // rather than for every search. only one solver may use a workspace at a time.
+    struct workspace {
+        size_t megabytes;
+        arena memory; // node storage, freed in one go at the start of every search
+        tt::table table; // state hash to node index
+        walker walk; // floods the node being expanded
+        walker normalise; // floods its successors to find their lowest reachable cell
+
+        // a quarter of the memory goes to the transposition table and the rest to storing states, which are
+        // taken from the arena 4MB at a time, or less when that is more than they may have.
+        explicit workspace(size_t megabytes) : megabytes(megabytes),
+                memory(std::min<size_t>(1 << 22, megabytes * 1024 * 1024 / 4 * 3)),
+                table(std::max<size_t>(1, megabytes / 4)) {}
+    };
+
+    // searches over the states of a puzzle, breadth first counting every move or only pushes, or best first
+    // (a*) counting box moves with the matcher's lower bound.
+    // states are stored in pages taken from the workspace's arena and found again through a transposition
+    // table of their indices. everything fits in the memory the solver is given: once the table is full, old
+    // entries are replaced and the states they pointed at may be searched again, and once the node storage is
+    // full the search gives up.
+    class solver {
+        private:
+            // nodes per page, pages never move so nodes can be pointed at while more are added
+            static const uint32_t PAGE = 4096;
+            struct node {
+                uint32_t parent;
+                int32_t player; // normalised to the lowest reachable cell when searching pushes
+                int32_t cell; // where the player stood for the move that led here
+                int8_t dir;
+                uint8_t stale; // a best first search found a shorter way to the same state since
+                uint16_t depth; // moves, pushes or box moves, whichever the search counts
+            };
+
+            const puzzle& _p;
+            std::unique_ptr<workspace> _owned; // set when the solver was not given a workspace
+            workspace& _w;
+            size_t _requested; // the node limit asked for
+            size_t _limit = 0; // and the one the memory allows
+            int _stride;
+            uint32_t _count = 0;
+            std::vector<node*> _nodes; // pages of nodes
+            std::vector<uint64_t*> _bits; // pages of every node's state, _stride words each
+            std::vector<int> _single; // the only cell moves are made from when counting every move
+            // for best first searches, every node's assignment and the nodes still to expand by their estimated length
+            std::unique_ptr<matcher> _match;
+            std::vector<int32_t*> _assignments;
+            std::vector<std::vector<uint32_t>> _open;
+            size_t _lowest = 0; // no bucket below this holds anything
+
+            node& _node(uint32_t i) {
+                return _nodes[i / PAGE][i % PAGE];
+            }
+
+            uint64_t * _state(uint32_t i) {
+                return _bits[i / PAGE] + (size_t)(i % PAGE) * _stride;
+            }
+
+            int32_t * _assignment(uint32_t i) {
+                return _assignments[i / PAGE] + (size_t)(i % PAGE) * _match->slots();
+            }
+
+            // adds the state in bits as a new node unless it has been seen. returns false if it was a repeat.
+            // a best first search may find a state again by a shorter way, then it is added again and the old node goes stale.
+            bool _add(const uint64_t * bits, const node& n) {
+                uint64_t h = _p.hash(bits, n.player);
+                tt::entry e;
+                // the table only knows hashes, so a hit is checked against the stored state
+                if (_w.table.probe(h, e) && e.value < _count && _node(e.value).player == n.player
+                        && std::equal(bits, bits + _stride, _state(e.value))) {
+                    if (!_bounded || _node(e.value).depth <= n.depth) {
+                        return false;
+                    }
+                    _node(e.value).stale = 1;
+                }
+                if (_count % PAGE == 0) {
+                    _nodes.push_back(_w.memory.make<node>(PAGE));
+                    _bits.push_back(_w.memory.make<uint64_t>((size_t)PAGE * _stride));
+                    if (_bounded) {
+                        _assignments.push_back(_w.memory.make<int32_t>((size_t)PAGE * _match->slots()));
+                    }
+                }
+                _w.table.store(h, n.depth, _count);
+                _node(_count) = n;
+                std::copy(bits, bits + _stride, _state(_count));
+                _count++;
+                return true;
+            }
+
+            // rebuilds the moves from the start to node i.
+            void _trace(uint32_t i, result& r) {
+                std::vector<uint32_t> chain;
+                for (; i != 0; i = _node(i).parent) {
+                    chain.push_back(i);
+                }
+                std::vector<uint64_t> bits(_p.start);
+                int player = _p.player;
+                r.path.clear();
+                r.pushes = 0;
+                r.boxMoves = 0;
+                for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+                    const node& n = _node(*it);
+                    if (_pushes) {
+                        _w.walk.flood(_p, bits.data(), player);
+                        _w.walk.walkTo(_p, n.cell, r.path);
+                        player = n.cell;
+                    }
+                    int pushed;
+                    player = step(_p, bits.data(), player, n.dir, pushed);
+                    r.path.push_back(n.dir);
+                    r.pushes += pushed > 0;
+                    r.boxMoves += pushed;
+                    if (_pushes && macros && pushed == 1) {
+                        int more = 0;
+                        player = macro(_p, bits.data(), player, n.dir, _w.normalise, &r.path, &more);
+                        r.pushes += more;
+                        r.boxMoves += more;
+                    }
+                }
+                r.moves = r.path.size();
+            }
+
+            // the state of the last search, kept so it can be resumed or asked for its closest state
+            bool _pushes = true;
+            bool _bounded = false;
+            uint32_t _head = 0; // the next node to expand, breadth first
+            result _result;
+            uint32_t _best = 0; // the node with the most captured boxes, the earliest found wins ties
+            int _bestCaptured = -1;
+
+            void _begin(bool pushes, bool bounded) {
+                _w.memory.reset();
+                // entries left by earlier searches are checked against the stored state like any other, so
+                // rather than clearing the whole table they are only marked as the first to be replaced
+                _w.table.age();
+                _nodes.clear();
+                _bits.clear();
+                _assignments.clear();
+                _open.clear();
+                _lowest = 0;
+                _count = 0;
+                _pushes = pushes;
+                _bounded = bounded;
+                _head = 0;
+                _result = result();
+                _best = 0;
+                _bestCaptured = -1;
+                if (bounded && !_match) {
+                    _match.reset(new matcher(_p));
+                }
+                size_t perNode = _stride * sizeof(uint64_t) + sizeof(node) + (bounded ? _match->slots() * sizeof(int32_t) : 0);
+                _limit = std::min(_requested, _w.megabytes * 1024 * 1024 / 4 * 3 / perNode);
+                int startPlayer = pushes ? _w.walk.flood(_p, _p.start.data(), _p.player) : _p.player;
+                _add(_p.start.data(), {0, startPlayer, -1, -1, 0, 0});
+                if (bounded) {
+                    _match->solve(_p.start.data(), _assignment(0));
+                    int h = _match->bound(_assignment(0));
+                    if (h != -1) {
+                        _open.resize(h + 1);
+                        _open[h].push_back(0);
+                    }
+                }
+            }
+
+            // returns true and marks the search as given up if it has to stop before expanding another node.
+            bool _stop(result& r, std::chrono::steady_clock::time_point deadline) {
+                if (_count >= _limit) {
+                    r.exhausted = true;
+                    return true;
+                }
+                // an expansion floods the whole board and more, so reading the clock each time costs little
+                if (deadline != std::chrono::steady_clock::time_point::max()
+                        && std::chrono::steady_clock::now() >= deadline) {
+                    r.timedOut = true;
+                    return true;
+                }
+                return false;
+            }
+
+            // generates the successors of node i that are not obviously deadlocked, calling child(bits, player, cell, dir, boxMoves)
+            // for each, where player is normalised if searching pushes. stops and returns true as soon as child does.
+            template<typename F>
+            bool _expand(uint32_t i, result& r, std::vector<uint64_t>& next, F child) {
+                r.expanded++;
+                const int player = _node(i).player;
+                const uint64_t * bits = _state(i);
+                if (_pushes) {
+                    _w.walk.flood(_p, bits, player);
+                }
+                _single.assign(1, player);
+                const std::vector<int>& from = _pushes ? _w.walk.queue : _single;
+                for (int c : from) {
+                    for (int d = 0; d < 4; d++) {
+                        int n = _p.neighbour(c, d);
+                        // when counting pushes, only moves into a box lead anywhere new
+                        if (n == -1 || (_pushes && !test(bits, n))) {
+                            continue;
+                        }
+                        std::copy(bits, bits + _stride, next.begin());
+                        int pushed;
+                        int moved = step(_p, next.data(), c, d, pushed);
+                        int boxMoves = pushed;
+                        if (moved != -1 && _pushes && macros && pushed == 1) {
+                            moved = macro(_p, next.data(), moved, d, _w.normalise, nullptr, &boxMoves);
+                        }
+                        if (moved == -1 || (pushed > 0 && _p.deadlocked(next.data()))) {
+                            continue;
+                        }
+                        r.generated++;
+                        int at = _pushes ? _w.normalise.flood(_p, next.data(), moved) : moved;
+                        if (child(next.data(), at, c, d, boxMoves)) {
+                            return true;
+                        }
+                    }
+                }
+                return false;
+            }
+
+            // keeps track of the node with the most captured boxes, for closest().
+            void _consider(uint32_t i) {
+                int captured = count(_state(i) + _p.words, _p.words);
+                if (captured > _bestCaptured) {
+                    _best = i;
+                    _bestCaptured = captured;
+                }
+            }
+
+            // expands nodes breadth first until the search finishes or deadline passes.
+            result _run(std::chrono::steady_clock::time_point deadline) {
+                trace::span t(_pushes ? "search pushes" : "search moves");
+                result& r = _result;
+                r.timedOut = false;
+                if (_head == 0 && _p.solved(_p.start.data())) {
+                    _trace(0, r);
+                    r.solved = true;
+                    return r;
+                }
+                std::vector<uint64_t> next(_stride);
+                // nodes are appended in breadth first order, so the node list is the queue
+                for (; _head < _count; _head++) {
+                    const uint32_t i = _head;
+                    if (_stop(r, deadline)) {
+                        return r;
+                    }
+                    bool solved = _expand(i, r, next, [&](const uint64_t * bits, int at, int c, int d, int) {
+                        uint16_t depth = std::min(_node(i).depth + 1, 0xFFFF);
+                        if (!_add(bits, {i, at, c, (int8_t)d, 0, depth})) {
+                            return false;
+                        }
+                        _consider(_count - 1);
+                        return _p.solved(bits);
+                    });
+                    if (solved) {
+                        _trace(_count - 1, r);
+                        r.solved = true;
+                        _head = _count; // nothing left to resume
+                        return r;
+                    }
+                }
+                return r;
+            }
+
+            // expands nodes best first until the search finishes or deadline passes.
+            result _runBounded(std::chrono::steady_clock::time_point deadline) {
+                trace::span t("search bounded");
+                result& r = _result;
+                r.timedOut = false;
+                std::vector<uint64_t> next(_stride);
+                std::vector<int32_t> assignment(_match->slots());
+                while (true) {
+                    while (_lowest < _open.size() && _open[_lowest].empty()) {
+                        _lowest++;
+                    }
+                    if (_lowest >= _open.size()) {
+                        return r; // nothing left, there is no solution
+                    }
+                    // the newest node first among equals, which is the deepest more often than not
+                    const uint32_t i = _open[_lowest].back();
+                    if (_node(i).stale) {
+                        _open[_lowest].pop_back();
+                        continue;
+                    }
+                    // goals are only taken when they are expanded, so nothing shorter can still be waiting
+                    if (_p.solved(_state(i))) {
+                        _trace(i, r);
+                        r.solved = true;
+                        _open.clear();
+                        return r;
+                    }
+                    if (_stop(r, deadline)) {
+                        return r;
+                    }
+                    _open[_lowest].pop_back();
+                    const uint64_t * parent = _state(i);
+                    _expand(i, r, next, [&](const uint64_t * bits, int at, int c, int d, int boxMoves) {
+                        // a push moves one box as far as the assignment is concerned, so find where it went
+                        int from = -1, to = -1, moved = 0;
+                        for (int w = 0; w < _p.words; w++) {
+                            uint64_t before = parent[w] | parent[w + _p.words], after = bits[w] | bits[w + _p.words];
+                            uint64_t gone = parent[w] & ~bits[w], arrived = after & ~before;
+                            moved += __builtin_popcountll(gone);
+                            if (gone != 0) {
+                                from = w * 64 + __builtin_ctzll(gone);
+                            }
+                            if (arrived != 0) {
+                                to = w * 64 + __builtin_ctzll(arrived);
+                            }
+                        }
+                        if (moved == 1 && to != -1) {
+                            _match->update(_assignment(i), from, to, test(bits + _p.words, to), bits, assignment.data());
+                        } else {
+                            _match->solve(bits, assignment.data());
+                        }
+                        int h = _match->bound(assignment.data());
+                        if (h == -1) {
+                            return false; // some box can never reach a target
+                        }
+                        uint16_t depth = std::min(_node(i).depth + boxMoves, 0xFFFF);
+                        if (!_add(bits, {i, at, c, (int8_t)d, 0, depth})) {
+                            return false;
+                        }
+                        std::copy(assignment.begin(), assignment.end(), _assignment(_count - 1));
+                        _consider(_count - 1);
+                        size_t f = depth + h;
+                        if (f >= _open.size()) {
+                            _open.resize(f + 1);
+                        }
+                        _open[f].push_back(_count - 1);
+                        // macros can make the estimate drop by more than the step, so f may be below the current bucket
+                        _lowest = std::min(_lowest, f);
+                        return false;
+                    });
+                }
+            }
+
+        public:
+            // collapse tunnels and goal rooms into single pushes when searching pushes, see macro().
+            // solutions are then found over fewer, longer steps, so they may not have the fewest pushes.
+            bool macros = false;
+
+            // searches p in w, giving up once limit states have been stored or the workspace's memory is full.
+            solver(const puzzle& p, size_t limit, workspace& w) : _p(p), _w(w), _requested(limit), _stride(p.words * 2) {}
+
+            // searches p in a workspace of its own of about megabytes.
+            solver(const puzzle& p, size_t limit, size_t megabytes = 64) : _p(p),
+                    _owned(new workspace(megabytes)), _w(*_owned), _requested(limit), _stride(p.words * 2) {}
+
+            // finds a solution with the fewest pushes, stopping early with timedOut set if deadline passes.
+            result pushes(std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) {
+                _begin(true, false);
+                return _run(deadline);
+            }
+
+            // finds a solution with the fewest box moves, best first over the matcher's lower bound. where there are
+            // no chains to push that is also the fewest pushes, and it expands far fewer nodes than pushes() does.
+            result bounded(std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) {
+                _begin(true, true);
+                return _runBounded(deadline);
+            }
+
+            // finds a solution with the fewest moves, stopping early with timedOut set if deadline passes.
+            result moves(std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) {
+                _begin(false, false);
+                return _run(deadline);
+            }
+
+            // carries on a search that timed out from where it stopped, keeping everything it had found.
+            result resume(std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) {
+                return _bounded ? _runBounded(deadline) : _run(deadline);
+            }
+
+            // a lower bound on the box moves needed to solve the level, or -1 if it can be seen to be impossible.
+            int lowerBound() {
+                if (!_match) {
+                    _match.reset(new matcher(_p));
+                }
+                std::vector<int32_t> a(_match->slots());
+                _match->solve(_p.start.data(), a.data());
+                return _match->bound(a.data());
+            }
+
+            // after a search that did not finish, the moves to the state with the most captured boxes it reached.
+            // the path is empty if no push got anywhere.
+            std::vector<uint8_t> closest() {
+                result r;
+                _trace(_best, r);
+                return r.path;
+            }
+    };
+}
+
+#endif
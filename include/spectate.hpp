@@ -0,0 +1,440 @@
+// spectating: a game sends its frames over a local unix socket to any number of viewers.
+// each frame is encoded once, as the cells that changed since the one before, and the same buffer is queued for every
+// viewer and written with scatter/gather sends. a viewer that falls behind is not waited for: its queue is dropped
+// and it is sent a keyframe of the whole level every so often instead, until it keeps up again.
+//
+// messages (little endian), a 12-byte header then the payload:
+//   kind (u8, 'K' or 'D'), 3 unused bytes, sequence (u32), payload bytes (u32)
+// a keyframe ('K') holds width (u16), height (u16), level (u32) and then the level as map::serialise() writes it.
+// a delta ('D') holds 5-byte changes, the index of a character in that text (u32) and its new value (u8).
+// a delta applies to the frame numbered one before it, a viewer without that frame waits for the next keyframe.
+
+#ifndef SPECTATE_HPP
+#define SPECTATE_HPP
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace spectate {
+
+#ifndef _WIN32
+    const bool SUPPORTED = true;
+#else
+    const bool SUPPORTED = false;
+#endif
+
+    const size_t HEADER_SIZE = 12;
+    const size_t CHANGE_SIZE = 5;
+    // payloads claiming more bytes than this end the connection rather than being buffered
+    const uint32_t MAX_PAYLOAD = 1 << 24;
+
+    // an encoded message, shared by every viewer it is queued for.
+    using frame = std::shared_ptr<const std::vector<uint8_t>>;
+
+    inline void _put(std::vector<uint8_t>& out, uint64_t v, int bytes) {
+        for (int i = 0; i < bytes; i++) {
+            out.push_back((v >> (i*8)) & 0xFF);
+        }
+    }
+
+    inline uint64_t _get(const uint8_t * in, int bytes) {
+        uint64_t v = 0;
+        for (int i = 0; i < bytes; i++) {
+            v |= (uint64_t)in[i] << (i*8);
+        }
+        return v;
+    }
+
+    inline void _header(std::vector<uint8_t>& out, char kind, uint32_t sequence, uint32_t bytes) {
+        out.push_back(kind);
+        _put(out, 0, 3);
+        _put(out, sequence, 4);
+        _put(out, bytes, 4);
+    }
+
+    inline frame keyframe(uint32_t sequence, int width, int height, uint32_t level, const std::string& layout) {
+        auto out = std::make_shared<std::vector<uint8_t>>();
+        out->reserve(HEADER_SIZE + 8 + layout.size());
+        _header(*out, 'K', sequence, 8 + layout.size());
+        _put(*out, width, 2);
+        _put(*out, height, 2);
+        _put(*out, level, 4);
+        out->insert(out->end(), layout.begin(), layout.end());
+        return out;
+    }
+
+    // the changes that turn before into after, which must be the same length.
+    inline frame delta(uint32_t sequence, const std::string& before, const std::string& after) {
+        auto out = std::make_shared<std::vector<uint8_t>>();
+        _header(*out, 'D', sequence, 0);
+        for (size_t i = 0; i < after.size(); i++) {
+            if (before[i] != after[i]) {
+                _put(*out, i, 4);
+                out->push_back(after[i]);
+            }
+        }
+        uint32_t bytes = out->size() - HEADER_SIZE;
+        for (int i = 0; i < 4; i++) {
+            (*out)[8 + i] = (bytes >> (i*8)) & 0xFF;
+        }
+        return out;
+    }
+
+    // what a viewer knows of the game.
+    struct view {
+        bool synced = false; // false until the first keyframe
+        uint32_t sequence = 0;
+        int width = 0, height = 0;
+        uint32_t level = 0;
+        std::string layout;
+    };
+
+    // applies every whole message at the front of pending to v and removes them. returns -1 if pending holds
+    // something that is not a message, otherwise the number of messages that changed v.
+    inline int apply(std::vector<uint8_t>& pending, view& v) {
+        size_t at = 0;
+        int changed = 0;
+        while (pending.size() - at >= HEADER_SIZE) {
+            const uint8_t * m = pending.data() + at;
+            uint32_t sequence = _get(m + 4, 4), bytes = _get(m + 8, 4);
+            if ((m[0] != 'K' && m[0] != 'D') || bytes > MAX_PAYLOAD) {
+                return -1;
+            }
+            if (pending.size() - at - HEADER_SIZE < bytes) {
+                break;
+            }
+            const uint8_t * p = m + HEADER_SIZE;
+            if (m[0] == 'K' && bytes >= 8) {
+                v.width = _get(p, 2);
+                v.height = _get(p + 2, 2);
+                v.level = _get(p + 4, 4);
+                v.layout.assign((const char*)p + 8, bytes - 8);
+                v.sequence = sequence;
+                v.synced = true;
+                changed++;
+            } else if (m[0] == 'D' && v.synced && sequence == v.sequence + 1) {
+                for (size_t i = 0; i + CHANGE_SIZE <= bytes; i += CHANGE_SIZE) {
+                    uint32_t index = _get(p + i, 4);
+                    if (index < v.layout.size()) {
+                        v.layout[index] = p[i + 4];
+                    }
+                }
+                v.sequence = sequence;
+                changed++;
+            }
+            at += HEADER_SIZE + bytes;
+        }
+        pending.erase(pending.begin(), pending.begin() + at);
+        return changed;
+    }
+
+#ifndef _WIN32
+    inline bool _address(const std::string& path, sockaddr_un& a) {
+        std::memset(&a, 0, sizeof(a));
+        a.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(a.sun_path)) {
+            return false;
+        }
+        std::memcpy(a.sun_path, path.c_str(), path.size());
+        return true;
+    }
+#endif
+
+    // the game's end: accepts viewers and sends them its frames, never blocking.
+    class broadcaster {
+        public:
+            // frames a viewer may have waiting before it is dropped to keyframes
+            static const size_t MAX_QUEUED = 8;
+            // how often viewers that have fallen behind are sent a keyframe
+            static constexpr std::chrono::milliseconds KEYFRAME_EVERY{500};
+
+        private:
+            struct viewer {
+                explicit viewer(int fd) : fd(fd) {}
+
+                int fd;
+                std::deque<frame> queue;
+                size_t offset = 0; // bytes of the front frame already sent
+                bool behind = true; // waiting for a keyframe, new viewers start here
+                bool lagging = false; // fell behind, so only gets the periodic keyframes
+                std::chrono::steady_clock::time_point due{}; // when a lagging viewer gets its next keyframe
+            };
+
+            int _listen = -1;
+            std::string _path;
+            std::vector<viewer> _viewers;
+            uint32_t _sequence = 0;
+            int _width = 0, _height = 0;
+            uint32_t _level = 0;
+            std::string _layout;
+            frame _keyframe; // of the current frame, built once the first viewer needs it
+
+            frame _currentKeyframe() {
+                if (!_keyframe) {
+                    _keyframe = keyframe(_sequence, _width, _height, _level, _layout);
+                }
+                return _keyframe;
+            }
+
+            void _accept() {
+#ifndef _WIN32
+                while (true) {
+                    int fd = ::accept(_listen, nullptr, nullptr);
+                    if (fd == -1) {
+                        return;
+                    }
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+                    int on = 1;
+                    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+                    _viewers.emplace_back(fd);
+                }
+#endif
+            }
+
+            // queues a keyframe for every viewer waiting on one that is due it.
+            void _catchUp() {
+                if (_sequence == 0) {
+                    return;
+                }
+                auto now = std::chrono::steady_clock::now();
+                for (auto& v : _viewers) {
+                    if (v.behind && v.queue.empty() && (!v.lagging || now >= v.due)) {
+                        v.queue.push_back(_currentKeyframe());
+                        v.behind = v.lagging = false;
+                    }
+                }
+            }
+
+            // sends as much of each queue as the sockets will take. returns false for a viewer that has gone.
+            bool _send(viewer& v) {
+#ifndef _WIN32
+#ifdef MSG_NOSIGNAL
+                const int FLAGS = MSG_NOSIGNAL;
+#else
+                const int FLAGS = 0;
+#endif
+                while (!v.queue.empty()) {
+                    iovec io[16];
+                    int count = 0;
+                    for (auto it = v.queue.begin(); it != v.queue.end() && count < 16; it++, count++) {
+                        size_t skip = count == 0 ? v.offset : 0;
+                        io[count].iov_base = (void*)((*it)->data() + skip);
+                        io[count].iov_len = (*it)->size() - skip;
+                    }
+                    msghdr m = {};
+                    m.msg_iov = io;
+                    m.msg_iovlen = count;
+                    ssize_t sent = ::sendmsg(v.fd, &m, FLAGS);
+                    if (sent == -1) {
+                        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+                    }
+                    // retire the frames that went out whole
+                    size_t left = sent;
+                    while (!v.queue.empty() && left >= v.queue.front()->size() - v.offset) {
+                        left -= v.queue.front()->size() - v.offset;
+                        v.queue.pop_front();
+                        v.offset = 0;
+                    }
+                    v.offset += left;
+                    if (left > 0) {
+                        return true; // the socket is full
+                    }
+                }
+#endif
+                return true;
+            }
+
+        public:
+            broadcaster() = default;
+            broadcaster(const broadcaster&) = delete;
+            broadcaster& operator=(const broadcaster&) = delete;
+
+            ~broadcaster() {
+#ifndef _WIN32
+                for (auto& v : _viewers) {
+                    ::close(v.fd);
+                }
+                if (_listen != -1) {
+                    ::close(_listen);
+                    ::unlink(_path.c_str());
+                }
+#endif
+            }
+
+            // starts listening at path, replacing a socket left there by an earlier game. returns false on failure.
+            bool open(const std::string& path) {
+#ifndef _WIN32
+                sockaddr_un a;
+                struct stat st;
+                if (!_address(path, a)) {
+                    return false;
+                }
+                if (::stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+                    ::unlink(path.c_str());
+                }
+                _listen = ::socket(AF_UNIX, SOCK_STREAM, 0);
+                if (_listen == -1) {
+                    return false;
+                }
+                if (::bind(_listen, (sockaddr*)&a, sizeof(a)) != 0 || ::listen(_listen, SOMAXCONN) != 0) {
+                    ::close(_listen);
+                    _listen = -1;
+                    return false;
+                }
+                fcntl(_listen, F_SETFL, fcntl(_listen, F_GETFL) | O_NONBLOCK);
+#if !defined(MSG_NOSIGNAL) && !defined(SO_NOSIGPIPE)
+                // a viewer hanging up would otherwise kill the game when we next write to it.
+                std::signal(SIGPIPE, SIG_IGN);
+#endif
+                _path = path;
+                return true;
+#else
+                return false;
+#endif
+            }
+
+            size_t viewers() const {
+                return _viewers.size();
+            }
+
+            // makes layout, as map::serialise() writes it, the current frame and queues it for every viewer.
+            // level is shown to viewers, a change of it or of the size sends everyone a keyframe.
+            void publish(int width, int height, uint32_t level, const std::string& layout) {
+                bool whole = width != _width || height != _height || level != _level || layout.size() != _layout.size();
+                if (!whole && layout == _layout) {
+                    poll();
+                    return;
+                }
+                _sequence++;
+                _keyframe.reset();
+                frame d = whole ? nullptr : delta(_sequence, _layout, layout);
+                _width = width;
+                _height = height;
+                _level = level;
+                _layout = layout;
+                _accept();
+                for (auto& v : _viewers) {
+                    if (v.behind) {
+                        continue;
+                    } else if (v.queue.size() >= MAX_QUEUED) {
+                        // keep only what has been partly sent, the stream must stay whole
+                        while (v.queue.size() > (v.offset > 0 ? 1 : 0)) {
+                            v.queue.pop_back();
+                        }
+                        v.behind = v.lagging = true;
+                        v.due = std::chrono::steady_clock::now() + KEYFRAME_EVERY;
+                    } else if (whole) {
+                        v.queue.push_back(_currentKeyframe());
+                    } else {
+                        v.queue.push_back(d);
+                    }
+                }
+                poll();
+            }
+
+            // accepts new viewers and sends what is waiting. cheap enough to call on every pass of the game loop.
+            void poll() {
+                if (_listen == -1) {
+                    return;
+                }
+                _accept();
+                _catchUp();
+                for (size_t i = 0; i < _viewers.size(); ) {
+                    if (_send(_viewers[i])) {
+                        i++;
+                        continue;
+                    }
+#ifndef _WIN32
+                    ::close(_viewers[i].fd);
+#endif
+                    _viewers.erase(_viewers.begin() + i);
+                }
+            }
+    };
+
+    // the viewer's end of the socket.
+    class watcher {
+        private:
+            int _fd = -1;
+            std::vector<uint8_t> _pending;
+
+        public:
+            watcher() = default;
+            watcher(const watcher&) = delete;
+            watcher& operator=(const watcher&) = delete;
+
+            ~watcher() {
+#ifndef _WIN32
+                if (_fd != -1) {
+                    ::close(_fd);
+                }
+#endif
+            }
+
+            // connects to a game's socket at path. returns false if there is no game there.
+            bool open(const std::string& path) {
+#ifndef _WIN32
+                sockaddr_un a;
+                if (!_address(path, a)) {
+                    return false;
+                }
+                _fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+                return _fd != -1 && ::connect(_fd, (sockaddr*)&a, sizeof(a)) == 0;
+#else
+                return false;
+#endif
+            }
+
+            // waits until v changes, taking in everything that has arrived before returning so a viewer that is
+            // behind skips straight to the newest frame. returns false once the game has gone.
+            bool next(view& v) {
+#ifndef _WIN32
+                uint8_t buffer[1 << 16];
+                int changed = 0;
+                bool waiting = true; // block for the first read only
+                while (true) {
+                    ssize_t got = ::recv(_fd, buffer, sizeof(buffer), waiting ? 0 : MSG_DONTWAIT);
+                    if (got == -1 && !waiting && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                        if (changed > 0) {
+                            return true;
+                        }
+                        waiting = true;
+                        continue;
+                    } else if (got == -1 && errno == EINTR) {
+                        continue;
+                    } else if (got <= 0) {
+                        return false;
+                    }
+                    _pending.insert(_pending.end(), buffer, buffer + got);
+                    int applied = apply(_pending, v);
+                    if (applied < 0) {
+                        return false;
+                    }
+                    changed += applied;
+                    waiting = false;
+                }
+#else
+                return false;
+#endif
+            }
+    };
+}
+
+#endif
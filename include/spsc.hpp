@@ -0,0 +1,44 @@
+// a lock-free, bounded, single-producer/single-consumer queue.
+// one thread may push and one other thread may pop, concurrently, without either ever blocking.
+
+#ifndef SPSC_HPP
+#define SPSC_HPP
+
+#include <atomic>
+#include <cstddef>
+
+template<typename T, size_t N>
+class spsc {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "the capacity of an spsc queue must be a power of two");
+
+    private:
+        T _items[N];
+        // kept on separate cache lines so the two threads do not fight over them
+        alignas(64) std::atomic<size_t> _head{0}; // next item to pop, only written by the consumer
+        alignas(64) std::atomic<size_t> _tail{0}; // next free slot, only written by the producer
+
+    public:
+        // adds item to the back of the queue, returns false if it is full. producer only.
+        bool push(const T& item) {
+            size_t tail = _tail.load(std::memory_order_relaxed);
+            if (tail - _head.load(std::memory_order_acquire) == N) {
+                return false;
+            }
+            _items[tail & (N - 1)] = item;
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // takes the item at the front of the queue, returns false if it is empty. consumer only.
+        bool pop(T& item) {
+            size_t head = _head.load(std::memory_order_relaxed);
+            if (head == _tail.load(std::memory_order_acquire)) {
+                return false;
+            }
+            item = _items[head & (N - 1)];
+            _head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+};
+
+#endif
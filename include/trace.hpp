@@ -0,0 +1,139 @@
+// a tiny chrome/perfetto trace-event recorder for boxpush.
+// every thread records its spans into its own fixed-size ring buffer, so recording never takes a lock.
+// when tracing is off a span costs a single relaxed atomic load.
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace trace {
+
+    // a single completed span.
+    struct event {
+        const char * name;
+        uint64_t start; // nanoseconds since the recorder was started
+        uint64_t duration;
+    };
+
+    // the number of events each thread keeps, the oldest are overwritten first.
+    const uint64_t RING_SIZE = 1 << 14;
+
+    // a single-producer ring of events, owned by one thread and only read when the trace is written.
+    struct ring {
+        event events[RING_SIZE];
+        std::atomic<uint64_t> head{0};
+        int tid = 0;
+        const char * name = nullptr;
+
+        void record(const event& e) {
+            uint64_t h = head.load(std::memory_order_relaxed);
+            events[h & (RING_SIZE - 1)] = e;
+            head.store(h + 1, std::memory_order_release);
+        }
+    };
+
+    inline std::atomic<bool> enabled{false};
+    inline std::string path;
+    inline uint64_t epoch = 0;
+    // rings outlive their threads so that spans from finished workers still make it into the file
+    inline std::mutex registryLock;
+    inline std::vector<std::unique_ptr<ring>> rings;
+
+    inline uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // returns the calling thread's ring, registering it on first use.
+    inline ring& local() {
+        thread_local ring * r = nullptr;
+        if (r == nullptr) {
+            std::lock_guard<std::mutex> lock(registryLock);
+            rings.push_back(std::make_unique<ring>());
+            r = rings.back().get();
+            r->tid = (int)rings.size();
+        }
+        return *r;
+    }
+
+    // names the calling thread in the trace viewer.
+    inline void name(const char * n) {
+        if (enabled.load(std::memory_order_relaxed)) {
+            local().name = n;
+        }
+    }
+
+    // records the time between its construction and destruction as a span called name.
+    // name must outlive the trace, string literals are expected.
+    class span {
+        private:
+            const char * _name;
+            uint64_t _start;
+
+        public:
+            explicit span(const char * n) : _name(n),
+                    _start(enabled.load(std::memory_order_relaxed) ? now() : 0) {}
+
+            ~span() {
+                if (_start != 0) {
+                    uint64_t end = now();
+                    local().record({_name, _start - epoch, end - _start});
+                }
+            }
+
+            span(const span&) = delete;
+            span& operator=(const span&) = delete;
+    };
+
+    // starts recording, the trace will be written to p by finish().
+    inline void start(const std::string& p) {
+        path = p;
+        epoch = now();
+        enabled.store(true);
+    }
+
+    // stops recording and writes every buffered event to the path given to start().
+    // returns false if nothing was recorded or the file could not be written.
+    inline bool finish() {
+        if (!enabled.exchange(false)) {
+            return false;
+        }
+        std::ofstream out(path);
+        if (!out) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(registryLock);
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        for (const auto& r : rings) {
+            if (r->name != nullptr) {
+                out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                    << r->tid << ",\"args\":{\"name\":\"" << r->name << "\"}}";
+                first = false;
+            }
+            uint64_t head = r->head.load(std::memory_order_acquire);
+            uint64_t from = head > RING_SIZE ? head - RING_SIZE : 0;
+            for (uint64_t i = from; i < head; i++) {
+                const event& e = r->events[i & (RING_SIZE - 1)];
+                // timestamps are in microseconds, keep the nanosecond precision as decimals
+                out << (first ? "" : ",") << "\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << r->tid
+                    << ",\"ts\":" << e.start / 1000 << "." << (e.start % 1000) / 100 << (e.start % 100) / 10 << e.start % 10
+                    << ",\"dur\":" << e.duration / 1000 << "." << (e.duration % 1000) / 100 << (e.duration % 100) / 10 << e.duration % 10
+                    << "}";
+                first = false;
+            }
+        }
+        out << "\n]}\n";
+        return out.good();
+    }
+}
+
+#endif
@@ -0,0 +1,132 @@
+// a bounded, lock-free transposition table for 64-bit state keys.
+// buckets are one cache line of four entries. an entry is two words, the data and the key xor'd with the data,
+// so a reader that races a writer sees a key that does not match rather than a torn entry (hyatt's lockless hashing).
+// when a bucket is full, entries from older generations go first, then those with the least depth.
+
+#ifndef TT_HPP
+#define TT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace tt {
+
+    // what an entry holds besides its key.
+    struct entry {
+        uint64_t value; // only the low 39 bits are kept
+        uint16_t depth;
+        uint8_t age;
+    };
+
+    const uint64_t VALUE_MASK = (1ULL << 39) - 1;
+    // set in the data of every stored entry, so that a zero data word always means an empty slot
+    const uint64_t OCCUPIED = 1ULL << 39;
+
+    class table {
+        private:
+            struct slot {
+                std::atomic<uint64_t> check{0}; // key ^ data, 0 when empty
+                std::atomic<uint64_t> data{0};
+            };
+            struct alignas(64) bucket {
+                slot slots[4];
+            };
+
+            std::unique_ptr<bucket[]> _buckets;
+            size_t _mask = 0; // bucket count - 1
+            std::atomic<uint8_t> _age{0};
+
+            static uint64_t _pack(uint64_t value, uint16_t depth, uint8_t age) {
+                return (value & VALUE_MASK) | OCCUPIED | ((uint64_t)depth << 40) | ((uint64_t)age << 56);
+            }
+
+            static entry _unpack(uint64_t data) {
+                return { data & VALUE_MASK, (uint16_t)(data >> 40), (uint8_t)(data >> 56) };
+            }
+
+            // keys are expected to be well mixed already, such as zobrist hashes
+            bucket& _bucket(uint64_t key) const {
+                return _buckets[key & _mask];
+            }
+
+        public:
+            // allocates the largest power of two number of buckets that fits in megabytes, at least one.
+            explicit table(size_t megabytes) {
+                size_t count = 1;
+                while (count * 2 * sizeof(bucket) <= megabytes * 1024 * 1024) {
+                    count *= 2;
+                }
+                _buckets.reset(new bucket[count]);
+                _mask = count - 1;
+            }
+
+            // the number of entries the table can hold.
+            size_t capacity() const {
+                return (_mask + 1) * 4;
+            }
+
+            // the memory the table takes up, in bytes.
+            size_t bytes() const {
+                return (_mask + 1) * sizeof(bucket);
+            }
+
+            // starts a new generation, entries stored before it are replaced first.
+            void age() {
+                _age.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // empties the table. not safe to call while other threads use it.
+            void clear() {
+                for (size_t i = 0; i <= _mask; i++) {
+                    for (auto& s : _buckets[i].slots) {
+                        s.check.store(0, std::memory_order_relaxed);
+                        s.data.store(0, std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            // looks key up, returns true and fills e if it is present.
+            bool probe(uint64_t key, entry& e) const {
+                for (const auto& s : _bucket(key).slots) {
+                    uint64_t check = s.check.load(std::memory_order_acquire);
+                    uint64_t data = s.data.load(std::memory_order_relaxed);
+                    if ((check ^ data) == key && data != 0) {
+                        e = _unpack(data);
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            // stores key, replacing its old entry or the least useful one in its bucket.
+            // concurrent stores never block each other, at worst one of two racing stores is lost.
+            void store(uint64_t key, uint16_t depth, uint64_t value) {
+                uint8_t now = _age.load(std::memory_order_relaxed);
+                uint64_t data = _pack(value, depth, now);
+                bucket& b = _bucket(key);
+                slot* victim = nullptr;
+                int worst = 1 << 30;
+                for (auto& s : b.slots) {
+                    uint64_t d = s.data.load(std::memory_order_relaxed);
+                    uint64_t c = s.check.load(std::memory_order_relaxed);
+                    if (d == 0 || (c ^ d) == key) {
+                        victim = &s;
+                        break;
+                    }
+                    // entries from this generation are worth more than any older one, then the deeper the better
+                    entry e = _unpack(d);
+                    int worth = (e.age == now ? 1 << 16 : 0) + e.depth;
+                    if (worth < worst) {
+                        worst = worth;
+                        victim = &s;
+                    }
+                }
+                victim->data.store(data, std::memory_order_relaxed);
+                victim->check.store(key ^ data, std::memory_order_release);
+            }
+    };
+}
+
+#endif